@@ -8,17 +8,33 @@
 // Memory block header
 typedef struct Block {
     size_t size;          // Size of the block (excluding header)
-    struct Block *next;   // Next free block
-    struct Block *prev;   // Previous free block
+    struct Block *next;   // Next block in address order
+    struct Block *prev;   // Previous block in address order
     int free;            // 1 if free, 0 if allocated
     int magic;           // Magic number for corruption detection
 } Block;
 
+// A free block keeps its size-class list links in its payload
+typedef struct {
+    Block *next_free;
+    Block *prev_free;
+} FreeLinks;
+
 #define BLOCK_SIZE sizeof(Block)
 #define MAGIC_FREE 0xDEADBEEF
 #define MAGIC_ALLOC 0xBEEFDEAD
 #define ALIGN_SIZE 8
-#define MIN_BLOCK_SIZE 16
+#define MIN_BLOCK_SIZE 16    // Room for FreeLinks
+
+// Segregated free lists (two-level, as in TLSF): the first level is the
+// power of two below the size, the second splits each power of two into
+// SL_COUNT equal classes. Bitmaps record which lists are non-empty, so a
+// fitting block is found with two bit scans instead of a list walk.
+#define FL_COUNT 64
+#define SL_BITS 3
+#define SL_COUNT (1 << SL_BITS)
+
+#define FREE_LINKS(block) ((FreeLinks *)((char *)(block) + BLOCK_SIZE))
 
 // Align size to 8-byte boundary
 size_t align_size(size_t size) {
@@ -30,7 +46,9 @@ typedef struct {
     void *heap_start;
     void *heap_end;
     size_t heap_size;
-    Block *free_list;
+    Block *bins[FL_COUNT][SL_COUNT];   // Free blocks by size class
+    uint64_t fl_bitmap;                // Bit fl set: some bins[fl][*] non-empty
+    uint32_t sl_bitmap[FL_COUNT];      // Bit sl set: bins[fl][sl] non-empty
     size_t allocated_bytes;
     size_t free_bytes;
     int allocation_count;
@@ -40,8 +58,76 @@ typedef struct {
 // Global allocator instance
 Allocator g_allocator = {0};
 
+// Index of the lowest / highest set bit of a non-zero value
+static int lowest_bit(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(value);
+#else
+    int bit = 0;
+    while (!(value & 1)) { value >>= 1; bit++; }
+    return bit;
+#endif
+}
+
+static int highest_bit(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(value);
+#else
+    int bit = 0;
+    while (value >>= 1) bit++;
+    return bit;
+#endif
+}
+
+// Size class of a block (size >= MIN_BLOCK_SIZE)
+static void size_class(size_t size, int *fl, int *sl) {
+    *fl = highest_bit(size);
+    *sl = (int)(size >> (*fl - SL_BITS)) - SL_COUNT;
+}
+
+// Add a free block to its size-class list
+static void insert_free_block(Block *block) {
+    int fl, sl;
+    size_class(block->size, &fl, &sl);
+    
+    FreeLinks *links = FREE_LINKS(block);
+    links->prev_free = NULL;
+    links->next_free = g_allocator.bins[fl][sl];
+    if (links->next_free) {
+        FREE_LINKS(links->next_free)->prev_free = block;
+    }
+    
+    g_allocator.bins[fl][sl] = block;
+    g_allocator.fl_bitmap |= (uint64_t)1 << fl;
+    g_allocator.sl_bitmap[fl] |= 1u << sl;
+}
+
+// Take a free block off its size-class list
+static void remove_free_block(Block *block) {
+    int fl, sl;
+    size_class(block->size, &fl, &sl);
+    
+    FreeLinks *links = FREE_LINKS(block);
+    if (links->prev_free) {
+        FREE_LINKS(links->prev_free)->next_free = links->next_free;
+    } else {
+        g_allocator.bins[fl][sl] = links->next_free;
+    }
+    if (links->next_free) {
+        FREE_LINKS(links->next_free)->prev_free = links->prev_free;
+    }
+    
+    if (!g_allocator.bins[fl][sl]) {
+        g_allocator.sl_bitmap[fl] &= ~(1u << sl);
+        if (!g_allocator.sl_bitmap[fl]) {
+            g_allocator.fl_bitmap &= ~((uint64_t)1 << fl);
+        }
+    }
+}
+
 // Initialize allocator with fixed heap size
 void allocator_init(size_t heap_size) {
+    memset(&g_allocator, 0, sizeof(g_allocator));
     g_allocator.heap_size = heap_size;
     g_allocator.heap_start = malloc(heap_size);
     if (!g_allocator.heap_start) {
@@ -58,29 +144,45 @@ void allocator_init(size_t heap_size) {
     initial->prev = NULL;
     initial->free = 1;
     initial->magic = MAGIC_FREE;
+    insert_free_block(initial);
     
-    g_allocator.free_list = initial;
     g_allocator.free_bytes = initial->size;
     g_allocator.allocated_bytes = 0;
     g_allocator.allocation_count = 0;
     g_allocator.free_count = 0;
 }
 
-// Find a suitable free block using first-fit strategy
+// Find a free block of at least size bytes in O(1): round size up to the
+// next class boundary, so every block in the chosen list fits, then take
+// the first non-empty list at or above that class. Only if there is none,
+// walk size's own class, whose larger blocks the rounding skipped.
 Block* find_free_block(size_t size) {
-    Block *current = g_allocator.free_list;
-    
-    while (current) {
-        if (current->free && current->size >= size) {
-            return current;
+    int fl, sl;
+    int fl_size = highest_bit(size);
+    size_class(size + ((size_t)1 << (fl_size - SL_BITS)) - 1, &fl, &sl);
+    
+    uint32_t sl_map = g_allocator.sl_bitmap[fl] & (~0u << sl);
+    if (!sl_map) {
+        uint64_t fl_map = fl + 1 < FL_COUNT ? g_allocator.fl_bitmap & (~(uint64_t)0 << (fl + 1)) : 0;
+        if (fl_map) {
+            fl = lowest_bit(fl_map);
+            sl_map = g_allocator.sl_bitmap[fl];
         }
-        current = current->next;
+    }
+    if (sl_map) {
+        return g_allocator.bins[fl][lowest_bit(sl_map)];
     }
     
+    size_class(size, &fl, &sl);
+    for (Block *block = g_allocator.bins[fl][sl]; block; block = FREE_LINKS(block)->next_free) {
+        if (block->size >= size) {
+            return block;
+        }
+    }
     return NULL;
 }
 
-// Split a block if it's too large
+// Split a block if it's too large; the rest goes back on a free list
 void split_block(Block *block, size_t size) {
     // Only split if remaining size is large enough
     if (block->size >= size + BLOCK_SIZE + MIN_BLOCK_SIZE) {
@@ -97,31 +199,37 @@ void split_block(Block *block, size_t size) {
         
         block->next = new_block;
         block->size = size;
+        insert_free_block(new_block);
     }
 }
 
-// Merge adjacent free blocks
-void coalesce_blocks() {
-    Block *current = g_allocator.free_list;
-    
-    while (current && current->next) {
-        if (current->free && current->next->free) {
-            // Check if blocks are adjacent
-            Block *next_expected = (Block *)((char *)current + BLOCK_SIZE + current->size);
-            if (next_expected == current->next) {
-                // Merge blocks
-                current->size += BLOCK_SIZE + current->next->size;
-                current->next = current->next->next;
-                if (current->next) {
-                    current->next->prev = current;
-                }
-            } else {
-                current = current->next;
-            }
-        } else {
-            current = current->next;
+// Merge a free block (not on a free list) with free neighbours; returns the
+// merged block
+Block* coalesce_block(Block *block) {
+    // Absorb the next block
+    if (block->next && block->next->free) {
+        Block *next = block->next;
+        remove_free_block(next);
+        block->size += BLOCK_SIZE + next->size;
+        block->next = next->next;
+        if (block->next) {
+            block->next->prev = block;
         }
     }
+    
+    // Let the previous block absorb this one
+    if (block->prev && block->prev->free) {
+        Block *prev = block->prev;
+        remove_free_block(prev);
+        prev->size += BLOCK_SIZE + block->size;
+        prev->next = block->next;
+        if (prev->next) {
+            prev->next->prev = prev;
+        }
+        block = prev;
+    }
+    
+    return block;
 }
 
 // Custom malloc implementation
@@ -129,6 +237,7 @@ void* my_malloc(size_t size) {
     if (size == 0) return NULL;
     
     size = align_size(size);
+    if (size < MIN_BLOCK_SIZE) size = MIN_BLOCK_SIZE;
     Block *block = find_free_block(size);
     
     if (!block) {
@@ -137,6 +246,7 @@ void* my_malloc(size_t size) {
     }
     
     // Split block if necessary
+    remove_free_block(block);
     split_block(block, size);
     
     // Mark block as allocated
@@ -160,7 +270,7 @@ void my_free(void *ptr) {
     Block *block = (Block *)((char *)ptr - BLOCK_SIZE);
     
     // Validate magic number
-    if (block->magic != MAGIC_ALLOC) {
+    if (block->magic != (int)MAGIC_ALLOC) {
         fprintf(stderr, "Corruption detected or double free!\n");
         return;
     }
@@ -175,7 +285,7 @@ void my_free(void *ptr) {
     g_allocator.free_count++;
     
     // Coalesce adjacent free blocks
-    coalesce_blocks();
+    insert_free_block(coalesce_block(block));
 }
 
 // Custom realloc implementation
@@ -216,6 +326,25 @@ void* my_calloc(size_t num, size_t size) {
     return ptr;
 }
 
+// Get size of largest free block: the longest one in the highest
+// non-empty size class
+size_t largest_free_block() {
+    if (!g_allocator.fl_bitmap) return 0;
+    
+    int fl = highest_bit(g_allocator.fl_bitmap);
+    int sl = highest_bit(g_allocator.sl_bitmap[fl]);
+    size_t max_size = 0;
+    
+    for (Block *current = g_allocator.bins[fl][sl]; current;
+         current = FREE_LINKS(current)->next_free) {
+        if (current->size > max_size) {
+            max_size = current->size;
+        }
+    }
+    
+    return max_size;
+}
+
 // Print allocator statistics
 void print_stats() {
     printf("\n=== Allocator Statistics ===\n");
@@ -229,21 +358,6 @@ void print_stats() {
            (100.0 * (1.0 - (double)largest_free_block() / g_allocator.free_bytes)) : 0);
 }
 
-// Get size of largest free block
-size_t largest_free_block() {
-    Block *current = g_allocator.free_list;
-    size_t max_size = 0;
-    
-    while (current) {
-        if (current->free && current->size > max_size) {
-            max_size = current->size;
-        }
-        current = current->next;
-    }
-    
-    return max_size;
-}
-
 // Visualize heap layout
 void visualize_heap() {
     printf("\n=== Heap Layout ===\n");
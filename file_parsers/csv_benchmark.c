@@ -0,0 +1,370 @@
+// CSV parser benchmark
+//
+// Generates synthetic corpora and measures every parse/write API on them,
+// reporting MB/s, rows/s, heap allocations and peak RSS.
+//
+// Build: gcc -O2 -o csv_benchmark csv_benchmark.c
+// Usage: ./csv_benchmark [size...]      sizes like 1K 10M 2G (default 1K 1M 64M)
+//
+// Corpora are written to $TMPDIR (default /tmp) and removed afterwards. Each
+// measurement runs in a forked child, so peak RSS is per API rather than the
+// high-water mark of the whole run.
+
+#define CSV_PARSER_NO_MAIN
+#include "csv_parser.c"
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+
+// Allocation counting
+//
+// On glibc the allocator entry points are interposed here and forwarded to
+// the real implementation, so allocations made inside libc (strndup, fopen)
+// are counted too.
+static atomic_size_t bench_allocations;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size) {
+    atomic_fetch_add_explicit(&bench_allocations, 1, memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    atomic_fetch_add_explicit(&bench_allocations, 1, memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    atomic_fetch_add_explicit(&bench_allocations, 1, memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+// Corpus generation
+typedef enum {
+    CORPUS_NARROW_NUMERIC,
+    CORPUS_WIDE_TEXT,
+    CORPUS_HEAVY_QUOTING,
+    CORPUS_EMBEDDED_NEWLINES,
+    CORPUS_COUNT
+} CorpusKind;
+
+static const char *corpus_names[CORPUS_COUNT] = {
+    "narrow-numeric", "wide-text", "heavy-quoting", "embedded-newlines"
+};
+
+// xorshift64: fast and reproducible
+static uint64_t bench_random(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static void write_word(FILE *file, uint64_t *rng) {
+    int length = 3 + bench_random(rng) % 8;
+    for (int i = 0; i < length; i++) {
+        fputc('a' + bench_random(rng) % 26, file);
+    }
+}
+
+// Write one record; returns the bytes written
+static size_t write_record(FILE *file, CorpusKind kind, uint64_t *rng) {
+    long start = ftell(file);
+    
+    switch (kind) {
+        case CORPUS_NARROW_NUMERIC:
+            fprintf(file, "%u,%d,%.3f,%u\n",
+                    (unsigned)(bench_random(rng) % 1000000),
+                    (int)(bench_random(rng) % 2000) - 1000,
+                    (bench_random(rng) % 100000) / 7.0,
+                    (unsigned)(bench_random(rng) % 100));
+            break;
+            
+        case CORPUS_WIDE_TEXT:
+            for (int col = 0; col < 40; col++) {
+                if (col > 0) fputc(',', file);
+                write_word(file, rng);
+            }
+            fputc('\n', file);
+            break;
+            
+        case CORPUS_HEAVY_QUOTING:
+            for (int col = 0; col < 8; col++) {
+                if (col > 0) fputc(',', file);
+                fputc('"', file);
+                write_word(file, rng);
+                fputs(", ", file);
+                write_word(file, rng);
+                fputs(" \"\"", file);
+                write_word(file, rng);
+                fputs("\"\"\"", file);
+            }
+            fputc('\n', file);
+            break;
+            
+        case CORPUS_EMBEDDED_NEWLINES:
+            for (int col = 0; col < 6; col++) {
+                if (col > 0) fputc(',', file);
+                if (col % 2) {
+                    fputc('"', file);
+                    write_word(file, rng);
+                    fputc('\n', file);
+                    write_word(file, rng);
+                    fputc('"', file);
+                } else {
+                    write_word(file, rng);
+                }
+            }
+            fputc('\n', file);
+            break;
+            
+        default:
+            break;
+    }
+    
+    return ftell(file) - start;
+}
+
+static bool generate_corpus(const char *path, CorpusKind kind, size_t size) {
+    FILE *file = fopen(path, "w");
+    if (!file) return false;
+    
+    setvbuf(file, NULL, _IOFBF, 1 << 20);
+    uint64_t rng = 0x9E3779B97F4A7C15ULL + kind;
+    size_t written = 0;
+    
+    while (written < size) {
+        written += write_record(file, kind, &rng);
+    }
+    
+    return fclose(file) == 0;
+}
+
+// Measurements
+typedef enum {
+    API_PARSE_FILE,
+    API_PARSE_SELECT,
+    API_PARSE_MMAP,
+    API_PARSE_PARALLEL,
+    API_STREAM,
+    API_PARSE_STRING,
+    API_WRITE_FILE,
+    API_COUNT
+} BenchApi;
+
+static const char *api_names[API_COUNT] = {
+    "csv_parse_file", "csv_parse_file_ex", "csv_parse_file_mmap", "csv_parse_file_parallel",
+    "csv_foreach_row", "csv_parse_string", "csv_write_file"
+};
+
+typedef struct {
+    bool ok;
+    double seconds;
+    size_t rows;
+    size_t allocations;
+    long peak_rss_kb;
+} BenchResult;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool count_row(const CSVRow *row, void *user_data) {
+    (void)row;
+    (*(size_t*)user_data)++;
+    return true;
+}
+
+// Selective read: keep about half of the rows, by the first byte of the
+// first projected column
+static bool keep_odd(const CSVRow *row, void *user_data) {
+    (void)user_data;
+    return row->field_count > 0 && row->fields[0].length > 0 &&
+           (row->fields[0].data[0] & 1);
+}
+
+// Read a whole file into a NUL-terminated buffer
+static char* load_file(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return NULL;
+    
+    fseeko(file, 0, SEEK_END);
+    off_t size = ftello(file);
+    fseeko(file, 0, SEEK_SET);
+    
+    char *buf = (char*)malloc(size + 1);
+    if (buf && fread(buf, 1, size, file) != (size_t)size) {
+        free(buf);
+        buf = NULL;
+    }
+    if (buf) buf[size] = '\0';
+    
+    fclose(file);
+    return buf;
+}
+
+// Run one API once (in the measuring child)
+static BenchResult run_api(BenchApi api, const char *path, const char *out_path) {
+    BenchResult result = {0};
+    CSVData *csv = NULL;
+    char *text = NULL;
+    
+    // Setup that should not be measured
+    if (api == API_PARSE_STRING && !(text = load_file(path))) return result;
+    if (api == API_WRITE_FILE && !(csv = csv_parse_file_mmap(path, ',', '"'))) return result;
+    
+    atomic_store(&bench_allocations, 0);
+    double start = now_seconds();
+    
+    switch (api) {
+        case API_PARSE_FILE:
+            csv = csv_parse_file(path, ',', '"');
+            break;
+        case API_PARSE_SELECT: {
+            // Two columns out of every corpus, filtered on the first
+            static const size_t columns[] = {2, 0};
+            CSVReadOptions options = {0};
+            options.columns = columns;
+            options.column_count = 2;
+            options.predicate = keep_odd;
+            csv = csv_parse_file_ex(path, ',', '"', &options);
+            break;
+        }
+        case API_PARSE_MMAP:
+            csv = csv_parse_file_mmap(path, ',', '"');
+            break;
+        case API_PARSE_PARALLEL:
+            csv = csv_parse_file_parallel(path, ',', '"', 0);
+            break;
+        case API_STREAM:
+            result.ok = csv_foreach_row(path, ',', '"', count_row, &result.rows);
+            break;
+        case API_PARSE_STRING:
+            csv = csv_parse_string(text, ',', '"');
+            break;
+        case API_WRITE_FILE:
+            result.ok = csv_write_file(csv, out_path);
+            result.rows = csv->row_count;
+            break;
+        default:
+            break;
+    }
+    
+    result.seconds = now_seconds() - start;
+    result.allocations = atomic_load(&bench_allocations);
+    
+    if (api != API_STREAM && api != API_WRITE_FILE) {
+        result.ok = csv != NULL;
+        result.rows = csv ? csv->row_count : 0;
+    }
+    
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    result.peak_rss_kb = usage.ru_maxrss;
+    
+    return result;
+}
+
+// Fork, measure in the child, and collect the result over a pipe
+static BenchResult measure(BenchApi api, const char *path, const char *out_path) {
+    BenchResult result = {0};
+    int fds[2];
+    if (pipe(fds) < 0) return result;
+    
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        BenchResult child = run_api(api, path, out_path);
+        ssize_t n = write(fds[1], &child, sizeof(child));
+        _exit(n == sizeof(child) ? 0 : 1);
+    }
+    
+    close(fds[1]);
+    if (pid > 0) {
+        if (read(fds[0], &result, sizeof(result)) != sizeof(result)) {
+            result.ok = false;
+        }
+        waitpid(pid, NULL, 0);
+    }
+    close(fds[0]);
+    
+    return result;
+}
+
+// Parse "64M"-style sizes
+static size_t parse_size(const char *text) {
+    char *end;
+    double value = strtod(text, &end);
+    switch (toupper((unsigned char)*end)) {
+        case 'K': value *= 1024; break;
+        case 'M': value *= 1024 * 1024; break;
+        case 'G': value *= 1024.0 * 1024 * 1024; break;
+        default: break;
+    }
+    return (size_t)value;
+}
+
+int main(int argc, char **argv) {
+    const char *default_sizes[] = { "1K", "1M", "64M" };
+    const char **sizes = argc > 1 ? (const char**)argv + 1 : default_sizes;
+    int size_count = argc > 1 ? argc - 1 : 3;
+    
+    const char *tmpdir = getenv("TMPDIR");
+    if (!tmpdir || !*tmpdir) tmpdir = "/tmp";
+    
+    char path[512], out_path[512];
+    snprintf(out_path, sizeof(out_path), "%s/csv_bench_out.csv", tmpdir);
+    
+    printf("%-18s %8s %-24s %10s %12s %12s %10s\n",
+           "corpus", "size", "api", "MB/s", "rows/s", "allocs", "peak MB");
+    
+    for (int s = 0; s < size_count; s++) {
+        size_t size = parse_size(sizes[s]);
+        if (size == 0) {
+            fprintf(stderr, "Invalid size: %s\n", sizes[s]);
+            return 1;
+        }
+        
+        for (int kind = 0; kind < CORPUS_COUNT; kind++) {
+            snprintf(path, sizeof(path), "%s/csv_bench_%s_%s.csv",
+                     tmpdir, corpus_names[kind], sizes[s]);
+            if (!generate_corpus(path, (CorpusKind)kind, size)) {
+                fprintf(stderr, "Failed to generate %s\n", path);
+                return 1;
+            }
+            
+            struct stat st;
+            stat(path, &st);
+            double megabytes = st.st_size / (1024.0 * 1024.0);
+            
+            for (int api = 0; api < API_COUNT; api++) {
+                BenchResult r = measure((BenchApi)api, path, out_path);
+                if (!r.ok) {
+                    printf("%-18s %8s %-24s %10s\n", corpus_names[kind], sizes[s],
+                           api_names[api], "failed");
+                    continue;
+                }
+                
+                double seconds = r.seconds > 0 ? r.seconds : 1e-9;
+                printf("%-18s %8s %-24s %10.1f %12.0f %12zu %10.1f\n",
+                       corpus_names[kind], sizes[s], api_names[api],
+                       megabytes / seconds, r.rows / seconds, r.allocations,
+                       r.peak_rss_kb / 1024.0);
+            }
+            
+            remove(path);
+        }
+    }
+    
+    remove(out_path);
+    return 0;
+}
@@ -1,8 +1,33 @@
+#define _GNU_SOURCE     // O_DIRECT
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include <strings.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Compressed input: build with -DCSV_WITH_ZLIB -lz and/or -DCSV_WITH_ZSTD -lzstd
+#ifdef CSV_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef CSV_WITH_ZSTD
+#include <zstd.h>
+#endif
 
 // CSV Parser with dynamic memory allocation
 
@@ -10,15 +35,111 @@
 typedef struct {
     char *data;
     size_t length;
+    bool owned;         // false when data is a view or lives in an arena
 } CSVField;
 
 // Structure to hold a CSV row
 typedef struct {
     CSVField *fields;
     size_t field_count;
-    size_t capacity;
+    size_t capacity;    // 0 when fields live in an arena
 } CSVRow;
 
+// Arena allocator
+//
+// Parsed tables take their field arrays and field copies from a bump
+// allocator: a list of large chunks that are only released together, so
+// parsing makes a handful of allocations and freeing does not walk rows.
+#define CSV_ARENA_MIN_CHUNK (64 * 1024)
+#define CSV_ARENA_MAX_CHUNK (64 * 1024 * 1024)
+
+typedef struct CSVArenaChunk {
+    struct CSVArenaChunk *next;
+    size_t size;
+    size_t used;
+    char data[];
+} CSVArenaChunk;
+
+typedef struct {
+    CSVArenaChunk *head;    // Chunk being filled; older chunks follow
+    size_t next_size;
+} CSVArena;
+
+// Allocate size bytes (8-byte aligned) from the arena
+static void* csv_arena_alloc(CSVArena *arena, size_t size) {
+    size = (size + 7) & ~(size_t)7;
+    
+    CSVArenaChunk *chunk = arena->head;
+    if (!chunk || chunk->size - chunk->used < size) {
+        size_t chunk_size = arena->next_size ? arena->next_size : CSV_ARENA_MIN_CHUNK;
+        if (chunk_size < CSV_ARENA_MAX_CHUNK) {
+            arena->next_size = chunk_size * 2;
+        }
+        if (chunk_size < size) chunk_size = size;
+        
+        chunk = (CSVArenaChunk*)malloc(sizeof(CSVArenaChunk) + chunk_size);
+        if (!chunk) return NULL;
+        
+        chunk->next = arena->head;
+        chunk->size = chunk_size;
+        chunk->used = 0;
+        arena->head = chunk;
+    }
+    
+    void *ptr = chunk->data + chunk->used;
+    chunk->used += size;
+    return ptr;
+}
+
+// Copy a string into the arena, NUL-terminated
+static char* csv_arena_strndup(CSVArena *arena, const char *data, size_t length) {
+    char *copy = (char*)csv_arena_alloc(arena, length + 1);
+    if (copy) {
+        memcpy(copy, data, length);
+        copy[length] = '\0';
+    }
+    return copy;
+}
+
+// Move all of src's chunks into dst
+static void csv_arena_merge(CSVArena *dst, CSVArena *src) {
+    if (!src->head) return;
+    
+    CSVArenaChunk *tail = src->head;
+    while (tail->next) tail = tail->next;
+    
+    tail->next = dst->head;
+    dst->head = src->head;
+    src->head = NULL;
+}
+
+// Forget every allocation but keep the newest (largest) chunk for reuse
+static void csv_arena_reset(CSVArena *arena) {
+    CSVArenaChunk *chunk = arena->head;
+    if (!chunk) return;
+    
+    CSVArenaChunk *older = chunk->next;
+    while (older) {
+        CSVArenaChunk *next = older->next;
+        free(older);
+        older = next;
+    }
+    chunk->next = NULL;
+    chunk->used = 0;
+}
+
+// Release every chunk
+static void csv_arena_free(CSVArena *arena) {
+    CSVArenaChunk *chunk = arena->head;
+    while (chunk) {
+        CSVArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->head = NULL;
+    arena->next_size = 0;
+}
+
 // Structure to hold entire CSV data
 typedef struct {
     CSVRow *rows;
@@ -26,6 +147,10 @@ typedef struct {
     size_t capacity;
     char delimiter;
     char quote_char;
+    void *mapping;      // File mapping backing field views (mmap mode)
+    size_t mapping_size;
+    bool use_arena;     // Parsed rows are allocated from arena
+    CSVArena arena;
 } CSVData;
 
 // Initialize CSV data structure
@@ -38,14 +163,30 @@ CSVData* csv_init(char delimiter, char quote_char) {
     csv->capacity = 0;
     csv->delimiter = delimiter ? delimiter : ',';
     csv->quote_char = quote_char ? quote_char : '"';
+    csv->mapping = NULL;
+    csv->mapping_size = 0;
+    csv->use_arena = false;
+    csv->arena.head = NULL;
+    csv->arena.next_size = 0;
     
     return csv;
 }
 
+// Initialize CSV data whose parsed rows are allocated from an arena and
+// released all at once by csv_free. A row that grows with csv_add_field
+// moves its field array to the heap.
+CSVData* csv_init_arena(char delimiter, char quote_char) {
+    CSVData *csv = csv_init(delimiter, quote_char);
+    if (csv) csv->use_arena = true;
+    return csv;
+}
+
 // Free a single field
 void csv_free_field(CSVField *field) {
     if (field && field->data) {
-        free(field->data);
+        if (field->owned) {
+            free(field->data);
+        }
         field->data = NULL;
         field->length = 0;
     }
@@ -57,36 +198,71 @@ void csv_free_row(CSVRow *row) {
         for (size_t i = 0; i < row->field_count; i++) {
             csv_free_field(&row->fields[i]);
         }
-        free(row->fields);
+        if (row->capacity > 0) {
+            free(row->fields);
+        }
         row->fields = NULL;
         row->field_count = 0;
         row->capacity = 0;
     }
 }
 
+// Drop a row's fields but keep its field array for reuse
+void csv_row_reset(CSVRow *row) {
+    for (size_t i = 0; i < row->field_count; i++) {
+        csv_free_field(&row->fields[i]);
+    }
+    row->field_count = 0;
+}
+
 // Free entire CSV data
 void csv_free(CSVData *csv) {
     if (csv) {
+        // Arena rows (capacity 0) go away with the arena; only rows that
+        // grew with csv_add_field own heap memory
         for (size_t i = 0; i < csv->row_count; i++) {
-            csv_free_row(&csv->rows[i]);
+            if (!csv->use_arena || csv->rows[i].capacity > 0) {
+                csv_free_row(&csv->rows[i]);
+            }
         }
         free(csv->rows);
+        csv_arena_free(&csv->arena);
+        if (csv->mapping) {
+            munmap(csv->mapping, csv->mapping_size);
+        }
         free(csv);
     }
 }
 
-// Add a field to a row
-bool csv_add_field(CSVRow *row, const char *data, size_t length) {
-    // Resize if needed
+// Make room for one more field in a row. A field array in an arena
+// (capacity 0) is copied to the heap rather than reallocated.
+static bool csv_reserve_field(CSVRow *row) {
     if (row->field_count >= row->capacity) {
         size_t new_capacity = row->capacity == 0 ? 4 : row->capacity * 2;
-        CSVField *new_fields = (CSVField*)realloc(row->fields, 
-                                                   new_capacity * sizeof(CSVField));
+        if (new_capacity <= row->field_count) new_capacity = row->field_count * 2;
+        
+        CSVField *new_fields;
+        if (row->capacity == 0 && row->fields) {
+            new_fields = (CSVField*)malloc(new_capacity * sizeof(CSVField));
+            if (new_fields) {
+                memcpy(new_fields, row->fields, row->field_count * sizeof(CSVField));
+            }
+        } else {
+            new_fields = (CSVField*)realloc(row->fields, 
+                                            new_capacity * sizeof(CSVField));
+        }
         if (!new_fields) return false;
         
         row->fields = new_fields;
         row->capacity = new_capacity;
     }
+    return true;
+}
+
+// Add a field to a row
+bool csv_add_field(CSVRow *row, const char *data, size_t length) {
+    // Resize if needed
+    if (!csv_reserve_field(row)) return false;
     
     // Allocate and copy field data
     row->fields[row->field_count].data = (char*)malloc(length + 1);
@@ -95,6 +271,52 @@ bool csv_add_field(CSVRow *row, const char *data, size_t length) {
     memcpy(row->fields[row->field_count].data, data, length);
     row->fields[row->field_count].data[length] = '\0';
     row->fields[row->field_count].length = length;
+    row->fields[row->field_count].owned = true;
+    row->field_count++;
+    
+    return true;
+}
+
+// Add a field that points into a buffer owned by someone else (no copy,
+// not NUL-terminated)
+bool csv_add_field_view(CSVRow *row, const char *data, size_t length) {
+    if (!csv_reserve_field(row)) return false;
+    
+    row->fields[row->field_count].data = (char*)data;
+    row->fields[row->field_count].length = length;
+    row->fields[row->field_count].owned = false;
+    row->field_count++;
+    
+    return true;
+}
+
+// Copy a quoted field's contents to dst (length + 1 bytes) with doubled
+// quotes collapsed; returns the new length
+static size_t csv_unescape(char *dst, const char *data, size_t length, char quote_char) {
+    size_t j = 0;
+    for (size_t i = 0; i < length; i++) {
+        dst[j++] = data[i];
+        if (data[i] == quote_char && i + 1 < length && data[i + 1] == quote_char) {
+            i++; // Skip the escaping quote
+        }
+    }
+    dst[j] = '\0';
+    return j;
+}
+
+// Add a copy of a quoted field's contents with doubled quotes collapsed
+bool csv_add_field_unescaped(CSVRow *row, const char *data, size_t length,
+                             char quote_char) {
+    if (!csv_reserve_field(row)) return false;
+    
+    char *copy = (char*)malloc(length + 1);
+    if (!copy) return false;
+    
+    size_t j = csv_unescape(copy, data, length, quote_char);
+    
+    row->fields[row->field_count].data = copy;
+    row->fields[row->field_count].length = j;
+    row->fields[row->field_count].owned = true;
     row->field_count++;
     
     return true;
@@ -121,291 +343,2634 @@ bool csv_add_row(CSVData *csv) {
     return true;
 }
 
-// Parse a CSV line
-bool csv_parse_line(CSVData *csv, const char *line) {
+// Append a row holding the fields tokenized into scratch. Views stay views
+// unless copy is set; the scratch row is left ready for csv_row_reset.
+static bool csv_append_row(CSVData *csv, CSVRow *scratch, bool copy) {
     if (!csv_add_row(csv)) return false;
     
-    CSVRow *current_row = &csv->rows[csv->row_count - 1];
-    const char *field_start = line;
-    const char *p = line;
-    bool in_quotes = false;
-    bool field_has_quotes = false;
+    CSVRow *row = &csv->rows[csv->row_count - 1];
+    size_t count = scratch->field_count;
+    if (count == 0) return true;
     
-    while (*p) {
-        if (*p == csv->quote_char) {
-            if (p == field_start || *(p - 1) == csv->delimiter) {
-                in_quotes = true;
-                field_has_quotes = true;
-                field_start = p + 1;
-            } else if (in_quotes) {
-                if (*(p + 1) == csv->quote_char) {
-                    // Escaped quote
-                    p++;
-                } else {
-                    in_quotes = false;
-                }
-            }
-        } else if (*p == csv->delimiter && !in_quotes) {
-            // End of field
-            size_t length = p - field_start;
-            if (field_has_quotes && length > 0) {
-                length--; // Remove closing quote
-            }
+    if (csv->use_arena) {
+        row->fields = (CSVField*)csv_arena_alloc(&csv->arena, count * sizeof(CSVField));
+        if (!row->fields) return false;
+        
+        for (size_t i = 0; i < count; i++) {
+            CSVField *src = &scratch->fields[i];
+            CSVField *dst = &row->fields[i];
             
-            if (!csv_add_field(current_row, field_start, length)) {
-                return false;
+            dst->data = src->data;
+            dst->length = src->length;
+            dst->owned = false;
+            if (copy || src->owned) {
+                dst->data = csv_arena_strndup(&csv->arena, src->data, src->length);
+                if (!dst->data) return false;
             }
-            
-            field_start = p + 1;
-            field_has_quotes = false;
-        } else if (*p == '\n' || *p == '\r') {
-            break;
+            row->field_count++;
         }
-        p++;
+        return true;
     }
     
-    // Add last field
-    size_t length = p - field_start;
-    if (field_has_quotes && length > 0) {
-        length--; // Remove closing quote
-    }
+    row->fields = (CSVField*)malloc(count * sizeof(CSVField));
+    if (!row->fields) return false;
+    row->capacity = count;
     
-    // Skip empty trailing field if line ends with delimiter
-    if (length > 0 || *(p - 1) != csv->delimiter) {
-        if (!csv_add_field(current_row, field_start, length)) {
-            return false;
+    for (size_t i = 0; i < count; i++) {
+        CSVField *src = &scratch->fields[i];
+        CSVField *dst = &row->fields[i];
+        
+        *dst = *src;
+        if (src->owned) {
+            src->owned = false; // Moved
+        } else if (copy) {
+            dst->data = strndup(src->data, src->length);
+            if (!dst->data) return false;
+            dst->owned = true;
         }
+        row->field_count++;
     }
-    
     return true;
 }
 
-// Parse CSV file
-CSVData* csv_parse_file(const char *filename, char delimiter, char quote_char) {
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        fprintf(stderr, "Error opening file: %s\n", filename);
-        return NULL;
+// Structural character scanning
+//
+// The tokenizer classifies input 64 bytes at a time into bitmasks (bit i is
+// byte i of the block) and then only visits the delimiters and line breaks
+// that lie outside quotes. The quoted regions come from a prefix-XOR of the
+// quote mask: every quote toggles the state, so a doubled quote inside a
+// quoted field toggles it off and straight back on. A quote only opens a
+// field right after a delimiter or line break, though, so the rare block
+// with a quote in the middle of an unquoted field (5'11") is redone one
+// byte at a time.
+#define CSV_BLOCK_SIZE 64
+
+typedef struct {
+    uint64_t delimiter;
+    uint64_t quote;
+    uint64_t newline;   // '\n' or '\r'
+} CSVBlockMasks;
+
+typedef void (*CSVStructuralFn)(const char *block, char delimiter,
+                                char quote_char, CSVBlockMasks *masks);
+
+// Portable fallback: one byte at a time
+static void csv_find_structurals_scalar(const char *block, char delimiter,
+                                        char quote_char, CSVBlockMasks *masks) {
+    masks->delimiter = 0;
+    masks->quote = 0;
+    masks->newline = 0;
+    
+    for (int i = 0; i < CSV_BLOCK_SIZE; i++) {
+        uint64_t bit = 1ULL << i;
+        if (block[i] == delimiter) masks->delimiter |= bit;
+        else if (block[i] == quote_char) masks->quote |= bit;
+        else if (block[i] == '\n' || block[i] == '\r') masks->newline |= bit;
     }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// SSE2: four 16-byte compares per block
+__attribute__((target("sse2")))
+static void csv_find_structurals_sse2(const char *block, char delimiter,
+                                      char quote_char, CSVBlockMasks *masks) {
+    const __m128i delim = _mm_set1_epi8(delimiter);
+    const __m128i quote = _mm_set1_epi8(quote_char);
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
     
-    CSVData *csv = csv_init(delimiter, quote_char);
-    if (!csv) {
-        fclose(file);
-        return NULL;
+    masks->delimiter = 0;
+    masks->quote = 0;
+    masks->newline = 0;
+    
+    for (int i = 0; i < CSV_BLOCK_SIZE; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(block + i));
+        uint64_t d = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, delim));
+        uint64_t q = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote));
+        uint64_t n = (uint32_t)_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, cr)));
+        masks->delimiter |= d << i;
+        masks->quote |= q << i;
+        masks->newline |= n << i;
     }
+}
+
+// AVX2: two 32-byte compares per block
+__attribute__((target("avx2")))
+static void csv_find_structurals_avx2(const char *block, char delimiter,
+                                      char quote_char, CSVBlockMasks *masks) {
+    const __m256i delim = _mm256_set1_epi8(delimiter);
+    const __m256i quote = _mm256_set1_epi8(quote_char);
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i cr = _mm256_set1_epi8('\r');
     
-    char *line = NULL;
-    size_t line_capacity = 0;
-    ssize_t line_length;
+    masks->delimiter = 0;
+    masks->quote = 0;
+    masks->newline = 0;
     
-    // Dynamic line reading
-    while ((line_length = getline(&line, &line_capacity, file)) != -1) {
-        // Skip empty lines
-        if (line_length > 0 && line[0] != '\n' && line[0] != '\r') {
-            if (!csv_parse_line(csv, line)) {
-                fprintf(stderr, "Error parsing line\n");
-                free(line);
-                fclose(file);
-                csv_free(csv);
-                return NULL;
+    for (int i = 0; i < CSV_BLOCK_SIZE; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(block + i));
+        uint64_t d = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, delim));
+        uint64_t q = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quote));
+        uint64_t n = (uint32_t)_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, lf), _mm256_cmpeq_epi8(v, cr)));
+        masks->delimiter |= d << i;
+        masks->quote |= q << i;
+        masks->newline |= n << i;
+    }
+}
+#endif
+
+// Pick the widest classifier the CPU supports
+static CSVStructuralFn csv_select_structural_fn(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return csv_find_structurals_avx2;
+    if (__builtin_cpu_supports("sse2")) return csv_find_structurals_sse2;
+#endif
+    return csv_find_structurals_scalar;
+}
+
+// Bit i of the result is the XOR of bits 0..i of x
+static inline uint64_t csv_prefix_xor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+// Cursor over the structural characters of a buffer
+typedef struct {
+    const char *end;            // End of the buffer
+    const char *block;          // Start of the current block
+    const char *next_block;     // Start of the next block to classify
+    uint64_t structurals;       // Unvisited delimiters/line breaks outside quotes
+    uint64_t in_quotes;         // All ones if the next block starts inside quotes
+    uint64_t field_start;       // 1 if a quote starting the next block opens a field
+    bool stray_quotes;          // Saw a quote in the middle of an unquoted field
+    char delimiter;
+    char quote_char;
+    CSVStructuralFn find_structurals;
+    CSVArena *arena;            // If set, unescaped copies are made here
+    const bool *keep;           // If set, only fields i < keep_count with keep[i]
+    size_t keep_count;          // are stored; the rest are skipped
+} CSVScanner;
+
+static void csv_scanner_init(CSVScanner *sc, char delimiter, char quote_char,
+                             const char *buf, size_t length) {
+    sc->end = buf + length;
+    sc->block = buf;
+    sc->next_block = buf;
+    sc->structurals = 0;
+    sc->in_quotes = 0;
+    sc->field_start = 1;
+    sc->stray_quotes = false;
+    sc->delimiter = delimiter;
+    sc->quote_char = quote_char;
+    sc->find_structurals = csv_select_structural_fn();
+    sc->arena = NULL;
+    sc->keep = NULL;
+    sc->keep_count = 0;
+}
+
+// Quote state of a block the slow way: a quote outside a quoted field only
+// opens one if it follows a delimiter, a line break or the closing quote of
+// a doubled quote; any other is part of the field's text. Returns the mask
+// of bytes inside quotes.
+static uint64_t csv_scanner_quotes_scalar(CSVScanner *sc, const char *block,
+                                          uint64_t valid) {
+    bool in_quotes = sc->in_quotes != 0;
+    bool at_start = sc->field_start != 0;
+    uint64_t inside = 0;
+    
+    for (int i = 0; i < CSV_BLOCK_SIZE && (valid >> i & 1); i++) {
+        char c = block[i];
+        bool closed = false;
+        
+        if (c == sc->quote_char) {
+            if (in_quotes) {
+                in_quotes = false;
+                closed = true;
+            } else if (at_start) {
+                in_quotes = true;
+            } else {
+                sc->stray_quotes = true;
             }
         }
+        
+        if (in_quotes) inside |= 1ULL << i;
+        at_start = closed || c == sc->delimiter || c == '\n' || c == '\r';
     }
     
-    free(line);
-    fclose(file);
-    return csv;
+    sc->field_start = at_start;
+    return inside;
 }
 
-// Parse CSV from string
-CSVData* csv_parse_string(const char *str, char delimiter, char quote_char) {
-    CSVData *csv = csv_init(delimiter, quote_char);
-    if (!csv) return NULL;
+// Classify the next block. A short tail is copied into a padded buffer so
+// the SIMD loads never read past the end of the input.
+static void csv_scanner_load(CSVScanner *sc) {
+    size_t remaining = sc->end - sc->next_block;
+    const char *src = sc->next_block;
+    char tail[CSV_BLOCK_SIZE];
+    uint64_t valid = ~0ULL;
     
-    const char *line_start = str;
-    const char *p = str;
-    
-    while (*p) {
-        if (*p == '\n') {
-            size_t line_length = p - line_start;
-            char *line = (char*)malloc(line_length + 1);
-            if (!line) {
-                csv_free(csv);
-                return NULL;
-            }
-            
-            memcpy(line, line_start, line_length);
-            line[line_length] = '\0';
-            
-            if (line_length > 0) {
-                if (!csv_parse_line(csv, line)) {
-                    free(line);
-                    csv_free(csv);
-                    return NULL;
-                }
-            }
-            
-            free(line);
-            line_start = p + 1;
-        }
-        p++;
+    if (remaining < CSV_BLOCK_SIZE) {
+        memset(tail, 0, sizeof(tail));
+        memcpy(tail, src, remaining);
+        src = tail;
+        valid = (1ULL << remaining) - 1;
     }
     
-    // Parse last line if no trailing newline
-    if (line_start < p) {
-        if (!csv_parse_line(csv, line_start)) {
-            csv_free(csv);
-            return NULL;
-        }
+    CSVBlockMasks masks;
+    sc->find_structurals(src, sc->delimiter, sc->quote_char, &masks);
+    
+    uint64_t quote = masks.quote & valid;
+    uint64_t inside = csv_prefix_xor(quote) ^ sc->in_quotes;
+    
+    // The prefix-XOR is right if every quote it takes as opening a field
+    // directly follows a delimiter, a line break or a closing quote
+    uint64_t ends = masks.delimiter | masks.newline | (quote & ~inside);
+    if (quote & inside & ~((ends << 1) | sc->field_start)) {
+        inside = csv_scanner_quotes_scalar(sc, src, valid);
+    } else {
+        sc->field_start = ends >> 63;
     }
     
-    return csv;
+    sc->in_quotes = (uint64_t)((int64_t)inside >> 63);
+    sc->structurals = (masks.delimiter | masks.newline) & ~inside & valid;
+    
+    sc->block = sc->next_block;
+    sc->next_block += remaining < CSV_BLOCK_SIZE ? remaining : CSV_BLOCK_SIZE;
 }
 
-// Get field value
-const char* csv_get_field(CSVData *csv, size_t row, size_t col) {
-    if (!csv || row >= csv->row_count) return NULL;
-    if (col >= csv->rows[row].field_count) return NULL;
-    return csv->rows[row].fields[col].data;
+// Position of the next delimiter or line break outside quotes, or end
+static const char* csv_scanner_next(CSVScanner *sc) {
+    while (sc->structurals == 0) {
+        if (sc->next_block >= sc->end) return sc->end;
+        csv_scanner_load(sc);
+    }
+    
+    int bit = __builtin_ctzll(sc->structurals);
+    sc->structurals &= sc->structurals - 1;
+    return sc->block + bit;
 }
 
-// Print CSV data
-void csv_print(CSVData *csv) {
-    if (!csv) return;
+// Store the field spanning [start, stop). Surrounding quotes are stripped.
+// With copy == false the field is a view into the input and only quoted
+// fields that contain doubled quotes get a private unescaped copy, taken
+// from the scanner's arena when it has one.
+static bool csv_emit_field(CSVRow *row, const char *start, const char *stop,
+                           const CSVScanner *sc, bool copy) {
+    size_t length = stop - start;
+    char quote_char = sc->quote_char;
     
-    printf("CSV Data (%zu rows):\n", csv->row_count);
-    for (size_t i = 0; i < csv->row_count; i++) {
-        printf("Row %zu: ", i);
-        for (size_t j = 0; j < csv->rows[i].field_count; j++) {
-            printf("[%s]", csv->rows[i].fields[j].data);
-            if (j < csv->rows[i].field_count - 1) {
-                printf(" ");
+    if (length >= 2 && start[0] == quote_char && stop[-1] == quote_char) {
+        start++;
+        length -= 2;
+        if (memchr(start, quote_char, length)) {
+            if (!sc->arena) {
+                return csv_add_field_unescaped(row, start, length, quote_char);
             }
+            
+            char *unescaped = (char*)csv_arena_alloc(sc->arena, length + 1);
+            if (!unescaped) return false;
+            length = csv_unescape(unescaped, start, length, quote_char);
+            return csv_add_field_view(row, unescaped, length);
         }
-        printf("\n");
     }
+    
+    return copy ? csv_add_field(row, start, length)
+                : csv_add_field_view(row, start, length);
 }
 
-// Write CSV to file
-bool csv_write_file(CSVData *csv, const char *filename) {
-    FILE *file = fopen(filename, "w");
-    if (!file) return false;
+// Tokenize the record starting at p (the scanner's current position) into
+// row. Quoted fields may span line breaks. Returns a pointer just past the
+// record terminator, or NULL if a field could not be stored. If terminated
+// is given it reports whether the record ended in a line break rather than
+// at the end of the buffer.
+static const char* csv_scan_record(CSVRow *row, CSVScanner *sc, const char *p,
+                                   bool copy, bool *terminated) {
+    const char *record_start = p;
+    const char *field_start = p;
+    size_t field = 0;
     
-    for (size_t i = 0; i < csv->row_count; i++) {
-        for (size_t j = 0; j < csv->rows[i].field_count; j++) {
-            const char *field = csv->rows[i].fields[j].data;
-            
-            // Check if field needs quoting
-            bool needs_quotes = false;
-            for (const char *p = field; *p; p++) {
-                if (*p == csv->delimiter || *p == csv->quote_char || 
-                    *p == '\n' || *p == '\r') {
-                    needs_quotes = true;
-                    break;
-                }
-            }
-            
-            if (needs_quotes) {
-                fputc(csv->quote_char, file);
-                for (const char *p = field; *p; p++) {
-                    if (*p == csv->quote_char) {
-                        fputc(csv->quote_char, file); // Escape quote
-                    }
-                    fputc(*p, file);
-                }
-                fputc(csv->quote_char, file);
-            } else {
-                fputs(field, file);
+    for (;;) {
+        const char *s = csv_scanner_next(sc);
+        bool keep = !sc->keep || (field < sc->keep_count && sc->keep[field]);
+        
+        if (s < sc->end && *s == sc->delimiter) {
+            if (keep && !csv_emit_field(row, field_start, s, sc, copy)) {
+                return NULL;
             }
-            
-            if (j < csv->rows[i].field_count - 1) {
-                fputc(csv->delimiter, file);
+            field_start = s + 1;
+            field++;
+            continue;
+        }
+        
+        // Last field; skip an empty one after a trailing delimiter
+        if (keep && (s > field_start || field_start == record_start)) {
+            if (!csv_emit_field(row, field_start, s, sc, copy)) {
+                return NULL;
             }
         }
-        fputc('\n', file);
+        
+        if (terminated) *terminated = s < sc->end;
+        if (s == sc->end) return s;
+        
+        // "\r\n" ends the record at the '\n', which is the next structural
+        if (*s == '\r' && s + 1 < sc->end && s[1] == '\n') {
+            s = csv_scanner_next(sc);
+        }
+        return s + 1;
     }
-    
-    fclose(file);
-    return true;
 }
 
-// Advanced CSV parser with header support
-typedef struct {
-    CSVData *data;
-    char **headers;
-    size_t header_count;
-} CSVTable;
-
-CSVTable* csv_parse_with_headers(const char *filename, char delimiter, char quote_char) {
-    CSVData *data = csv_parse_file(filename, delimiter, quote_char);
-    if (!data || data->row_count == 0) return NULL;
-    
-    CSVTable *table = (CSVTable*)malloc(sizeof(CSVTable));
-    if (!table) {
-        csv_free(data);
-        return NULL;
-    }
-    
-    // First row as headers
-    table->header_count = data->rows[0].field_count;
-    table->headers = (char**)malloc(table->header_count * sizeof(char*));
-    if (!table->headers) {
-        free(table);
-        csv_free(data);
-        return NULL;
-    }
-    
-    // Copy headers
-    for (size_t i = 0; i < table->header_count; i++) {
-        table->headers[i] = strdup(data->rows[0].fields[i].data);
-    }
+// Parse a CSV line
+bool csv_parse_line(CSVData *csv, const char *line) {
+    CSVScanner scanner;
+    csv_scanner_init(&scanner, csv->delimiter, csv->quote_char, line, strlen(line));
     
-    // Remove header row from data
-    csv_free_row(&data->rows[0]);
-    memmove(&data->rows[0], &data->rows[1], 
-            (data->row_count - 1) * sizeof(CSVRow));
-    data->row_count--;
+    CSVRow scratch = {0};
+    bool ok = csv_scan_record(&scratch, &scanner, line, false, NULL) != NULL &&
+              csv_append_row(csv, &scratch, true);
     
-    table->data = data;
-    return table;
+    csv_free_row(&scratch);
+    return ok;
 }
 
-// Get field by header name
-const char* csv_get_field_by_name(CSVTable *table, size_t row, const char *header) {
-    if (!table || !header) return NULL;
+// Parse the records that start in [p, limit), storing fields as views (or
+// copies if copy is set). p must be a record start; the last record may run
+// on up to end. stray_quotes, if given, is set when a quote turned up in the
+// middle of an unquoted field.
+static bool csv_parse_range(CSVData *csv, const char *p, const char *limit,
+                            const char *end, bool copy, bool *stray_quotes) {
+    CSVScanner scanner;
+    csv_scanner_init(&scanner, csv->delimiter, csv->quote_char, p, end - p);
+    if (csv->use_arena) scanner.arena = &csv->arena;
     
-    // Find header index
-    size_t col = (size_t)-1;
-    for (size_t i = 0; i < table->header_count; i++) {
-        if (strcmp(table->headers[i], header) == 0) {
-            col = i;
+    CSVRow scratch = {0};
+    bool ok = true;
+    
+    while (p < limit) {
+        // Skip empty lines (each one is the next structural character)
+        if (*p == '\n' || *p == '\r') {
+            csv_scanner_next(&scanner);
+            p++;
+            continue;
+        }
+        
+        p = csv_scan_record(&scratch, &scanner, p, false, NULL);
+        if (!p || !csv_append_row(csv, &scratch, copy)) {
+            ok = false;
             break;
         }
+        csv_row_reset(&scratch);
     }
     
-    if (col == (size_t)-1) return NULL;
-    return csv_get_field(table->data, row, col);
+    csv_free_row(&scratch);
+    if (stray_quotes) *stray_quotes = scanner.stray_quotes;
+    return ok;
 }
 
-// Free CSV table
-void csv_table_free(CSVTable *table) {
-    if (table) {
-        for (size_t i = 0; i < table->header_count; i++) {
-            free(table->headers[i]);
-        }
-        free(table->headers);
-        csv_free(table->data);
-        free(table);
+// Parse every record in a memory buffer, storing fields as views into it
+static bool csv_parse_buffer(CSVData *csv, const char *buf, size_t length) {
+    return csv_parse_range(csv, buf, buf + length, buf + length, false, NULL);
+}
+
+// Input sources
+//
+// Where the streaming reader gets its bytes from: a plain file, a gzip or
+// zstd decompressor, or a threaded stage that runs another source ahead of
+// the parser. csv_source_open picks one from the file name, so .csv.gz and
+// .csv.zst files are decompressed on the fly with no temporary file.
+typedef struct CSVSource CSVSource;
+
+struct CSVSource {
+    // Read up to size bytes; returns the count, 0 at the end, -1 on error
+    long (*read)(CSVSource *source, char *buf, size_t size);
+    void (*close)(CSVSource *source);
+    FILE *file;             // The file itself for plain files, else NULL
+};
+
+void csv_source_close(CSVSource *source) {
+    if (source) source->close(source);
+}
+
+// Plain file. A short read is not the end: the file may still be growing
+// (follow mode), so only a read of 0 bytes is.
+static long csv_file_source_read(CSVSource *source, char *buf, size_t size) {
+    size_t n = fread(buf, 1, size, source->file);
+    if (n < size) {
+        if (ferror(source->file)) return -1;
+        clearerr(source->file); // More may be appended later
     }
+    return (long)n;
 }
 
-// Demo function
-void csv_parser_demo() {
-    printf("=== CSV Parser Demo ===\n\n");
+static void csv_file_source_close(CSVSource *source) {
+    fclose(source->file);
+    free(source);
+}
+
+CSVSource* csv_source_file(const char *filename) {
+    CSVSource *source = (CSVSource*)calloc(1, sizeof(CSVSource));
+    if (!source) return NULL;
     
-    // Create sample CSV data
-    const char *csv_string = 
-        "Name,Age,City,Salary\n"
+    source->file = fopen(filename, "rb");
+    if (!source->file) {
+        fprintf(stderr, "Error opening file: %s\n", filename);
+        free(source);
+        return NULL;
+    }
+    source->read = csv_file_source_read;
+    source->close = csv_file_source_close;
+    return source;
+}
+
+#ifdef CSV_WITH_ZLIB
+#define CSV_GZIP_BUFFER (256 * 1024)
+
+typedef struct {
+    CSVSource base;
+    gzFile gz;
+} CSVGzipSource;
+
+static long csv_gzip_source_read(CSVSource *source, char *buf, size_t size) {
+    CSVGzipSource *gs = (CSVGzipSource*)source;
+    if (size > INT_MAX) size = INT_MAX; // gzread returns an int
+    
+    int n = gzread(gs->gz, buf, (unsigned)size);
+    if (n <= 0) {
+        // A truncated file ends in a 0-byte read with Z_BUF_ERROR set
+        int code;
+        const char *message = gzerror(gs->gz, &code);
+        if (code != Z_OK) {
+            fprintf(stderr, "gzip: %s\n", message);
+            return -1;
+        }
+    }
+    return n;
+}
+
+static void csv_gzip_source_close(CSVSource *source) {
+    gzclose(((CSVGzipSource*)source)->gz);
+    free(source);
+}
+
+// gzip (or zlib) compressed file; uncompressed input passes through as-is
+CSVSource* csv_source_gzip(const char *filename) {
+    CSVGzipSource *gs = (CSVGzipSource*)calloc(1, sizeof(CSVGzipSource));
+    if (!gs) return NULL;
+    
+    gs->gz = gzopen(filename, "rb");
+    if (!gs->gz) {
+        fprintf(stderr, "Error opening file: %s\n", filename);
+        free(gs);
+        return NULL;
+    }
+    gzbuffer(gs->gz, CSV_GZIP_BUFFER);
+    
+    gs->base.read = csv_gzip_source_read;
+    gs->base.close = csv_gzip_source_close;
+    return &gs->base;
+}
+#endif
+
+#ifdef CSV_WITH_ZSTD
+typedef struct {
+    CSVSource base;
+    FILE *compressed;
+    ZSTD_DStream *stream;
+    ZSTD_inBuffer in;
+    char *in_buf;
+    size_t in_capacity;
+    size_t last_ret;        // 0 once the last frame is complete
+    bool input_done;
+} CSVZstdSource;
+
+static long csv_zstd_source_read(CSVSource *source, char *buf, size_t size) {
+    CSVZstdSource *zs = (CSVZstdSource*)source;
+    ZSTD_outBuffer out = {buf, size, 0};
+    
+    for (;;) {
+        if (zs->in.pos == zs->in.size && !zs->input_done) {
+            size_t n = fread(zs->in_buf, 1, zs->in_capacity, zs->compressed);
+            if (n == 0) {
+                if (ferror(zs->compressed)) return -1;
+                zs->input_done = true;
+            }
+            zs->in.src = zs->in_buf;
+            zs->in.size = n;
+            zs->in.pos = 0;
+        }
+        
+        // With no input left this still flushes what the decoder holds
+        size_t in_pos = zs->in.pos;
+        size_t ret = ZSTD_decompressStream(zs->stream, &out, &zs->in);
+        if (ZSTD_isError(ret)) {
+            fprintf(stderr, "zstd: %s\n", ZSTD_getErrorName(ret));
+            return -1;
+        }
+        if (zs->in.pos != in_pos || out.pos > 0) zs->last_ret = ret;
+        if (out.pos > 0) return (long)out.pos;
+        
+        if (zs->input_done && zs->in.pos == zs->in.size) {
+            if (zs->last_ret != 0) {
+                fprintf(stderr, "zstd: truncated input\n");
+                return -1;
+            }
+            return 0;
+        }
+    }
+}
+
+static void csv_zstd_source_close(CSVSource *source) {
+    CSVZstdSource *zs = (CSVZstdSource*)source;
+    ZSTD_freeDStream(zs->stream);
+    if (zs->compressed) fclose(zs->compressed);
+    free(zs->in_buf);
+    free(zs);
+}
+
+// zstd compressed file (any number of concatenated frames)
+CSVSource* csv_source_zstd(const char *filename) {
+    CSVZstdSource *zs = (CSVZstdSource*)calloc(1, sizeof(CSVZstdSource));
+    if (!zs) return NULL;
+    zs->base.read = csv_zstd_source_read;
+    zs->base.close = csv_zstd_source_close;
+    
+    zs->compressed = fopen(filename, "rb");
+    if (!zs->compressed) {
+        fprintf(stderr, "Error opening file: %s\n", filename);
+        csv_zstd_source_close(&zs->base);
+        return NULL;
+    }
+    
+    zs->in_capacity = ZSTD_DStreamInSize();
+    zs->in_buf = (char*)malloc(zs->in_capacity);
+    zs->stream = ZSTD_createDStream();
+    if (!zs->in_buf || !zs->stream || ZSTD_isError(ZSTD_initDStream(zs->stream))) {
+        csv_zstd_source_close(&zs->base);
+        return NULL;
+    }
+    return &zs->base;
+}
+#endif
+
+// Threaded stage: a producer thread reads the inner source into a ring of
+// chunks while the consumer (the parser) drains them, so decompression and
+// tokenizing overlap.
+#define CSV_PIPE_CHUNK (256 * 1024)
+#define CSV_PIPE_DEPTH 4
+
+typedef struct {
+    CSVSource base;
+    CSVSource *inner;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    char *chunks[CSV_PIPE_DEPTH];
+    long lengths[CSV_PIPE_DEPTH];   // Inner read result for each chunk
+    size_t produced;                // Chunks filled so far
+    size_t consumed;                // Chunks fully drained so far
+    size_t offset;                  // Bytes taken from the current chunk
+    bool stop;
+} CSVPipeSource;
+
+static void* csv_pipe_producer(void *arg) {
+    CSVPipeSource *ps = (CSVPipeSource*)arg;
+    
+    for (;;) {
+        pthread_mutex_lock(&ps->lock);
+        while (ps->produced - ps->consumed == CSV_PIPE_DEPTH && !ps->stop) {
+            pthread_cond_wait(&ps->changed, &ps->lock);
+        }
+        if (ps->stop) {
+            pthread_mutex_unlock(&ps->lock);
+            return NULL;
+        }
+        size_t slot = ps->produced % CSV_PIPE_DEPTH;
+        pthread_mutex_unlock(&ps->lock);
+        
+        // The slot is free until produced moves past it
+        long n = ps->inner->read(ps->inner, ps->chunks[slot], CSV_PIPE_CHUNK);
+        
+        pthread_mutex_lock(&ps->lock);
+        ps->lengths[slot] = n;
+        ps->produced++;
+        pthread_cond_broadcast(&ps->changed);
+        pthread_mutex_unlock(&ps->lock);
+        
+        if (n <= 0) return NULL; // End or error: leave it for the consumer
+    }
+}
+
+static long csv_pipe_source_read(CSVSource *source, char *buf, size_t size) {
+    CSVPipeSource *ps = (CSVPipeSource*)source;
+    
+    pthread_mutex_lock(&ps->lock);
+    while (ps->produced == ps->consumed) {
+        pthread_cond_wait(&ps->changed, &ps->lock);
+    }
+    size_t slot = ps->consumed % CSV_PIPE_DEPTH;
+    long length = ps->lengths[slot];
+    pthread_mutex_unlock(&ps->lock);
+    
+    if (length <= 0) return length; // Stays put, so later reads agree
+    
+    size_t n = length - ps->offset;
+    if (n > size) n = size;
+    memcpy(buf, ps->chunks[slot] + ps->offset, n);
+    ps->offset += n;
+    
+    if (ps->offset == (size_t)length) {
+        pthread_mutex_lock(&ps->lock);
+        ps->offset = 0;
+        ps->consumed++;
+        pthread_cond_broadcast(&ps->changed);
+        pthread_mutex_unlock(&ps->lock);
+    }
+    return (long)n;
+}
+
+static void csv_pipe_source_close(CSVSource *source) {
+    CSVPipeSource *ps = (CSVPipeSource*)source;
+    
+    pthread_mutex_lock(&ps->lock);
+    ps->stop = true;
+    pthread_cond_broadcast(&ps->changed);
+    pthread_mutex_unlock(&ps->lock);
+    pthread_join(ps->thread, NULL);
+    
+    ps->inner->close(ps->inner);
+    for (int i = 0; i < CSV_PIPE_DEPTH; i++) {
+        free(ps->chunks[i]);
+    }
+    pthread_mutex_destroy(&ps->lock);
+    pthread_cond_destroy(&ps->changed);
+    free(ps);
+}
+
+// Run inner on its own thread; takes ownership of inner (closed on failure)
+CSVSource* csv_source_threaded(CSVSource *inner) {
+    if (!inner) return NULL;
+    
+    CSVPipeSource *ps = (CSVPipeSource*)calloc(1, sizeof(CSVPipeSource));
+    bool ok = ps != NULL;
+    for (int i = 0; ok && i < CSV_PIPE_DEPTH; i++) {
+        ps->chunks[i] = (char*)malloc(CSV_PIPE_CHUNK);
+        ok = ps->chunks[i] != NULL;
+    }
+    if (!ok) {
+        if (ps) {
+            for (int i = 0; i < CSV_PIPE_DEPTH; i++) free(ps->chunks[i]);
+            free(ps);
+        }
+        inner->close(inner);
+        return NULL;
+    }
+    
+    ps->inner = inner;
+    ps->base.read = csv_pipe_source_read;
+    ps->base.close = csv_pipe_source_close;
+    pthread_mutex_init(&ps->lock, NULL);
+    pthread_cond_init(&ps->changed, NULL);
+    
+    if (pthread_create(&ps->thread, NULL, csv_pipe_producer, ps) != 0) {
+        pthread_mutex_destroy(&ps->lock);
+        pthread_cond_destroy(&ps->changed);
+        for (int i = 0; i < CSV_PIPE_DEPTH; i++) free(ps->chunks[i]);
+        free(ps);
+        inner->close(inner);
+        return NULL;
+    }
+    return &ps->base;
+}
+
+static bool csv_has_suffix(const char *name, const char *suffix) {
+    size_t n = strlen(name), m = strlen(suffix);
+    return n >= m && strcasecmp(name + n - m, suffix) == 0;
+}
+
+// Open filename as a source, decompressing .gz and .zst files on a
+// separate thread
+CSVSource* csv_source_open(const char *filename) {
+    if (csv_has_suffix(filename, ".gz")) {
+#ifdef CSV_WITH_ZLIB
+        return csv_source_threaded(csv_source_gzip(filename));
+#else
+        fprintf(stderr, "Built without gzip support (CSV_WITH_ZLIB): %s\n", filename);
+        return NULL;
+#endif
+    }
+    if (csv_has_suffix(filename, ".zst")) {
+#ifdef CSV_WITH_ZSTD
+        return csv_source_threaded(csv_source_zstd(filename));
+#else
+        fprintf(stderr, "Built without zstd support (CSV_WITH_ZSTD): %s\n", filename);
+        return NULL;
+#endif
+    }
+    return csv_source_file(filename);
+}
+
+// Streaming reader
+//
+// Reads a source through a fixed-size window and tokenizes one record at a
+// time into a single reused row, so memory stays constant no matter how big
+// the file is. Fields are views into the window (or, for quoted fields with
+// doubled quotes, into an arena reset per record) and stay valid only until
+// the next call to csv_reader_next. A record that does not fit the window
+// grows it, so memory is bounded by the longest record.
+#define CSV_READER_WINDOW (64 * 1024)
+
+typedef struct {
+    CSVSource *source;
+    char *window;
+    size_t window_size;
+    size_t filled;          // Valid bytes in the window
+    const char *pos;        // Start of the next record
+    off_t window_offset;    // Source offset of window[0]
+    bool eof;
+    bool error;
+    bool follow;            // Wait for appended data instead of ending
+    char *path;             // Follow mode: the file name, to notice replacement
+    char delimiter;
+    char quote_char;
+    const bool *keep;       // Column mask for the scanner (see CSVScanner)
+    size_t keep_count;
+    CSVScanner scanner;
+    CSVArena arena;         // Unescaped fields of the current record
+    CSVRow row;             // Reused for every record
+} CSVReader;
+
+// Row callback for csv_foreach_row; return false to stop early. Fields are
+// length-byte views with no terminating NUL.
+typedef bool (*CSVRowCallback)(const CSVRow *row, void *user_data);
+
+// Open a streaming reader over source, which it takes ownership of (and
+// closes on failure). window_size 0 picks CSV_READER_WINDOW.
+CSVReader* csv_reader_open_source(CSVSource *source, char delimiter, char quote_char,
+                                  size_t window_size) {
+    if (!source) return NULL;
+    
+    CSVReader *reader = (CSVReader*)calloc(1, sizeof(CSVReader));
+    if (!reader) {
+        csv_source_close(source);
+        return NULL;
+    }
+    
+    reader->window_size = window_size ? window_size : CSV_READER_WINDOW;
+    reader->window = (char*)malloc(reader->window_size);
+    if (!reader->window) {
+        csv_source_close(source);
+        free(reader);
+        return NULL;
+    }
+    
+    reader->source = source;
+    reader->delimiter = delimiter ? delimiter : ',';
+    reader->quote_char = quote_char ? quote_char : '"';
+    reader->pos = reader->window;
+    
+    return reader;
+}
+
+// Open a streaming reader on a file (compressed ones by extension)
+CSVReader* csv_reader_open(const char *filename, char delimiter, char quote_char,
+                           size_t window_size) {
+    return csv_reader_open_source(csv_source_open(filename), delimiter, quote_char,
+                                  window_size);
+}
+
+// Close a streaming reader
+void csv_reader_close(CSVReader *reader) {
+    if (reader) {
+        csv_free_row(&reader->row);
+        csv_arena_free(&reader->arena);
+        csv_source_close(reader->source);
+        free(reader->window);
+        free(reader->path);
+        free(reader);
+    }
+}
+
+// Move the unconsumed tail to the front of the window and read more after
+// it, growing the window if the tail already fills it. Returns the number
+// of bytes read (0 only at the end of the source), or -1 on error.
+static long csv_reader_fill(CSVReader *reader) {
+    size_t keep = reader->window + reader->filled - reader->pos;
+    
+    if (keep == reader->window_size) {
+        size_t new_size = reader->window_size * 2;
+        char *new_window = (char*)realloc(reader->window, new_size);
+        if (!new_window) return -1;
+        
+        reader->window = new_window;
+        reader->window_size = new_size;
+    } else if (keep > 0) {
+        memmove(reader->window, reader->pos, keep);
+    }
+    reader->window_offset += reader->filled - keep;
+    
+    long n = reader->source->read(reader->source, reader->window + keep,
+                                  reader->window_size - keep);
+    if (n < 0) return -1;
+    if (n == 0 && !reader->follow) reader->eof = true;
+    
+    reader->filled = keep + n;
+    reader->pos = reader->window;
+    csv_scanner_init(&reader->scanner, reader->delimiter, reader->quote_char,
+                     reader->window, reader->filled);
+    reader->scanner.arena = &reader->arena;
+    reader->scanner.keep = reader->keep;
+    reader->scanner.keep_count = reader->keep_count;
+    
+    return n;
+}
+
+// Source offset just past the last record returned
+off_t csv_reader_offset(const CSVReader *reader) {
+    return reader->window_offset + (reader->pos - reader->window);
+}
+
+// Read the next record. Returns NULL at end of file or on error (check
+// reader->error).
+const CSVRow* csv_reader_next(CSVReader *reader) {
+    csv_row_reset(&reader->row);
+    csv_arena_reset(&reader->arena);
+    
+    for (;;) {
+        const char *end = reader->window + reader->filled;
+        
+        // Skip empty lines (each one is the next structural character)
+        while (reader->pos < end && (*reader->pos == '\n' || *reader->pos == '\r')) {
+            csv_scanner_next(&reader->scanner);
+            reader->pos++;
+        }
+        
+        if (reader->pos < end) {
+            bool terminated;
+            const char *next = csv_scan_record(&reader->row, &reader->scanner,
+                                               reader->pos, false, &terminated);
+            if (!next) {
+                reader->error = true;
+                return NULL;
+            }
+            
+            if (terminated || reader->eof) {
+                reader->pos = next;
+                return &reader->row;
+            }
+            
+            // Record runs past the window: refill and rescan it
+            csv_row_reset(&reader->row);
+        } else if (reader->eof) {
+            return NULL;
+        }
+        
+        long n = csv_reader_fill(reader);
+        if (n < 0) {
+            reader->error = true;
+            return NULL;
+        }
+        
+        // Follow mode: only a partial record (or nothing) is available yet
+        if (n == 0 && reader->follow) return NULL;
+    }
+}
+
+// Follow mode
+//
+// For files that other processes keep appending to. A follow reader never
+// reaches end of file: csv_follow_poll appends the complete records written
+// since the last poll, and a partial last line stays in the window until
+// the rest of it arrives. csv_reader_offset gives the byte offset of the
+// first unparsed record, which can be saved and passed back to
+// csv_follow_open to resume later. A file truncated in place is followed
+// again from its start; a file replaced under the same name (renamed away
+// and recreated, as log rotation does) is finished and the new one is
+// followed from its start.
+
+// Open a reader in follow mode, starting at a record boundary offset
+CSVReader* csv_follow_open(const char *filename, char delimiter, char quote_char,
+                           off_t offset) {
+    CSVReader *reader = csv_reader_open_source(csv_source_file(filename), delimiter,
+                                               quote_char, 0);
+    if (!reader) return NULL;
+    
+    if (offset > 0 && fseeko(reader->source->file, offset, SEEK_SET) != 0) {
+        csv_reader_close(reader);
+        return NULL;
+    }
+    reader->path = strdup(filename);
+    if (!reader->path) {
+        csv_reader_close(reader);
+        return NULL;
+    }
+    reader->window_offset = offset;
+    reader->follow = true;
+    
+    return reader;
+}
+
+// Append the records the reader can complete now to csv
+static long csv_follow_read(CSVReader *reader, CSVData *csv) {
+    long appended = 0;
+    while (csv_reader_next(reader) != NULL) {
+        if (!csv_append_row(csv, &reader->row, true)) return -1;
+        appended++;
+    }
+    
+    return reader->error ? -1 : appended;
+}
+
+// Drop the window and start again at offset 0 of the source
+static void csv_follow_restart(CSVReader *reader) {
+    csv_row_reset(&reader->row);
+    reader->window_offset = 0;
+    reader->filled = 0;
+    reader->pos = reader->window;
+}
+
+// Append the records completed since the last poll to csv. Returns the
+// number of rows appended, or -1 on error.
+long csv_follow_poll(CSVReader *reader, CSVData *csv) {
+    struct stat opened, current;
+    if (fstat(fileno(reader->source->file), &opened) != 0) return -1;
+    
+    // Another file now has the name: read what is left of the open one,
+    // then switch. Until the name exists again, keep reading the old file.
+    if (stat(reader->path, &current) == 0 &&
+        (current.st_dev != opened.st_dev || current.st_ino != opened.st_ino)) {
+        long appended = csv_follow_read(reader, csv);
+        if (appended < 0) return -1;
+        
+        CSVSource *source = csv_source_file(reader->path);
+        if (!source) return -1;
+        csv_source_close(reader->source);
+        reader->source = source;
+        csv_follow_restart(reader);
+        
+        long more = csv_follow_read(reader, csv);
+        return more < 0 ? -1 : appended + more;
+    }
+    
+    // Shorter than what was already read: truncated in place
+    if (opened.st_size < reader->window_offset + (off_t)reader->filled) {
+        if (fseeko(reader->source->file, 0, SEEK_SET) != 0) return -1;
+        csv_follow_restart(reader);
+    }
+    
+    return csv_follow_read(reader, csv);
+}
+
+// Push-style streaming: call callback for every record of a file
+bool csv_foreach_row(const char *filename, char delimiter, char quote_char,
+                     CSVRowCallback callback, void *user_data) {
+    CSVReader *reader = csv_reader_open(filename, delimiter, quote_char, 0);
+    if (!reader) return false;
+    
+    const CSVRow *row;
+    while ((row = csv_reader_next(reader)) != NULL) {
+        if (!callback(row, user_data)) break;
+    }
+    
+    bool ok = !reader->error;
+    csv_reader_close(reader);
+    return ok;
+}
+
+// Read options
+//
+// Column projection and row filtering for csv_parse_file_ex. Unselected
+// fields are never stored: the scanner steps over their delimiters without
+// emitting them. The predicate sees each projected row as views into the
+// reader's window, so rejected rows are never copied into the result.
+
+// Row filter; return false to drop the row. Fields are length-byte views
+// with no terminating NUL.
+typedef bool (*CSVRowPredicate)(const CSVRow *row, void *user_data);
+
+typedef struct {
+    const size_t *columns;              // Columns to keep, in output order,
+    const char *const *column_names;    // by index or by header name
+    size_t column_count;                // 0 keeps every column
+    bool has_header;                    // First record is a header row: it is
+                                        // projected but never filtered
+    CSVRowPredicate predicate;          // Sees the projected row; NULL keeps all
+    void *user_data;
+} CSVReadOptions;
+
+// Resolved column selection
+typedef struct {
+    size_t *columns;        // Source column of each output column
+    size_t *slots;          // Position of each output column among kept fields
+    size_t count;
+    bool *keep;             // keep[i]: source column i is selected
+    size_t keep_count;      // Highest selected column + 1
+    CSVRow row;             // Reused output row (views only)
+} CSVProjection;
+
+static void csv_projection_free(CSVProjection *proj) {
+    free(proj->columns);
+    free(proj->slots);
+    free(proj->keep);
+    free(proj->row.fields);
+}
+
+// Find a header name among the fields of the header record; (size_t)-1 if
+// absent
+static size_t csv_find_header(const CSVRow *header, const char *name) {
+    size_t length = strlen(name);
+    for (size_t i = 0; i < header->field_count; i++) {
+        if (header->fields[i].length == length &&
+            memcmp(header->fields[i].data, name, length) == 0) {
+            return i;
+        }
+    }
+    return (size_t)-1;
+}
+
+// Resolve the selected columns (names against header, which may be NULL
+// when selecting by index) and build the scanner mask
+static bool csv_projection_init(CSVProjection *proj, const CSVReadOptions *options,
+                                const CSVRow *header) {
+    memset(proj, 0, sizeof(*proj));
+    proj->count = options->column_count;
+    proj->columns = (size_t*)malloc(proj->count * sizeof(size_t));
+    proj->slots = (size_t*)malloc(proj->count * sizeof(size_t));
+    if (!proj->columns || !proj->slots) return false;
+    
+    for (size_t k = 0; k < proj->count; k++) {
+        if (options->columns) {
+            proj->columns[k] = options->columns[k];
+        } else {
+            proj->columns[k] = csv_find_header(header, options->column_names[k]);
+            if (proj->columns[k] == (size_t)-1) {
+                fprintf(stderr, "Unknown column: %s\n", options->column_names[k]);
+                return false;
+            }
+        }
+        if (proj->columns[k] + 1 > proj->keep_count) {
+            proj->keep_count = proj->columns[k] + 1;
+        }
+    }
+    
+    proj->keep = (bool*)calloc(proj->keep_count, sizeof(bool));
+    if (proj->keep_count > 0 && !proj->keep) return false;
+    for (size_t k = 0; k < proj->count; k++) {
+        proj->keep[proj->columns[k]] = true;
+    }
+    
+    // Kept fields arrive in source order; a column's slot is the number of
+    // selected columns before it
+    for (size_t k = 0; k < proj->count; k++) {
+        size_t slot = 0;
+        for (size_t i = 0; i < proj->columns[k]; i++) {
+            slot += proj->keep[i];
+        }
+        proj->slots[k] = slot;
+    }
+    return true;
+}
+
+// Arrange the fields of a scanned record in output order. masked says the
+// record was scanned with the column mask, so it holds only kept fields.
+// Columns the record is too short to have come out empty.
+static CSVRow* csv_project_row(CSVProjection *proj, const CSVRow *record, bool masked) {
+    csv_row_reset(&proj->row);
+    for (size_t k = 0; k < proj->count; k++) {
+        size_t i = masked ? proj->slots[k] : proj->columns[k];
+        bool present = i < record->field_count;
+        if (!csv_add_field_view(&proj->row, present ? record->fields[i].data : "",
+                                present ? record->fields[i].length : 0)) {
+            return NULL;
+        }
+    }
+    return &proj->row;
+}
+
+// Parse CSV file, keeping only the columns and rows chosen by options
+// (NULL reads everything)
+CSVData* csv_parse_file_ex(const char *filename, char delimiter, char quote_char,
+                           const CSVReadOptions *options) {
+    CSVReader *reader = csv_reader_open(filename, delimiter, quote_char, 0);
+    if (!reader) return NULL;
+    
+    CSVData *csv = csv_init_arena(delimiter, quote_char);
+    if (!csv) {
+        csv_reader_close(reader);
+        return NULL;
+    }
+    
+    CSVProjection proj = {0};
+    bool project = options && options->column_count > 0;
+    bool header = options && options->has_header;
+    
+    // Names are resolved against the full header record
+    if (project && !options->columns) {
+        if (!header || !options->column_names) {
+            fprintf(stderr, "Selecting columns by name needs a header row\n");
+            reader->error = true;
+        } else if (csv_reader_next(reader) == NULL ||
+                   !csv_projection_init(&proj, options, &reader->row)) {
+            reader->error = true;
+        } else {
+            CSVRow *row = csv_project_row(&proj, &reader->row, false);
+            if (!row || !csv_append_row(csv, row, true)) {
+                reader->error = true;
+            }
+            header = false;
+        }
+    } else if (project && !csv_projection_init(&proj, options, NULL)) {
+        reader->error = true;
+    }
+    
+    if (project) {
+        reader->keep = proj.keep;
+        reader->keep_count = proj.keep_count;
+        reader->scanner.keep = proj.keep;
+        reader->scanner.keep_count = proj.keep_count;
+    }
+    
+    // Copy each streamed record that passes the filter into the table
+    while (!reader->error && csv_reader_next(reader) != NULL) {
+        CSVRow *row = project ? csv_project_row(&proj, &reader->row, true)
+                              : &reader->row;
+        if (!row) {
+            reader->error = true;
+            break;
+        }
+        
+        if (header) {
+            header = false;
+        } else if (options && options->predicate &&
+                   !options->predicate(row, options->user_data)) {
+            continue;
+        }
+        
+        if (!csv_append_row(csv, row, true)) {
+            reader->error = true;
+            break;
+        }
+    }
+    
+    csv_projection_free(&proj);
+    
+    if (reader->error) {
+        fprintf(stderr, "Error parsing line\n");
+        csv_reader_close(reader);
+        csv_free(csv);
+        return NULL;
+    }
+    
+    csv_reader_close(reader);
+    return csv;
+}
+
+// Parse CSV file
+CSVData* csv_parse_file(const char *filename, char delimiter, char quote_char) {
+    return csv_parse_file_ex(filename, delimiter, quote_char, NULL);
+}
+
+// Map a file read-only into csv->mapping. An empty file leaves the mapping
+// NULL.
+static bool csv_map_file(CSVData *csv, const char *filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error opening file: %s\n", filename);
+        return false;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return false;
+    }
+    
+    // Nothing to map for an empty file
+    if (st.st_size == 0) {
+        close(fd);
+        return true;
+    }
+    
+    void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "Error mapping file: %s\n", filename);
+        return false;
+    }
+    madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+    
+    csv->mapping = mapping;
+    csv->mapping_size = st.st_size;
+    return true;
+}
+
+// Parse CSV file through a read-only memory mapping (zero-copy mode).
+// Fields are views into the mapping and are NOT NUL-terminated, so use
+// csv_get_field_view to read them. The mapping lives until csv_free.
+CSVData* csv_parse_file_mmap(const char *filename, char delimiter, char quote_char) {
+    CSVData *csv = csv_init_arena(delimiter, quote_char);
+    if (!csv) return NULL;
+    
+    if (!csv_map_file(csv, filename)) {
+        csv_free(csv);
+        return NULL;
+    }
+    
+    if (!csv_parse_buffer(csv, (const char*)csv->mapping, csv->mapping_size)) {
+        fprintf(stderr, "Error parsing file\n");
+        csv_free(csv);
+        return NULL;
+    }
+    
+    return csv;
+}
+
+// Parallel parsing
+//
+// The mapped file is cut into fixed-size chunks and a small pool of threads
+// parses them. Each chunk owns the records that start inside it, but where
+// the first of those begins depends on whether the chunk starts inside a
+// quoted field. Workers speculate that it does not and count the chunk's
+// quotes at the same time; the quote parities then give the true starting
+// state of every chunk, and the (rare) mispredicted chunks are reparsed.
+// Parities only work if every quote toggles the state, so a file with a
+// quote in the middle of an unquoted field is parsed on one thread.
+#define CSV_MIN_CHUNK_SIZE (1 << 20)
+#define CSV_CHUNKS_PER_THREAD 4
+
+typedef struct {
+    const char *begin;          // Chunk range [begin, limit)
+    const char *limit;
+    const char *end;            // End of the whole buffer
+    bool starts_in_quotes;      // State assumed when parsing
+    bool quote_parity;          // Odd number of quotes in the chunk
+    bool stray_quotes;          // Quote parity cannot be trusted
+    bool needs_parse;
+    bool ok;
+    CSVData *rows;              // Records parsed from this chunk
+} CSVChunk;
+
+typedef struct {
+    CSVChunk *chunks;
+    size_t chunk_count;
+    atomic_size_t next_chunk;
+    char delimiter;
+    char quote_char;
+} CSVChunkQueue;
+
+// Number of quote characters in [p, end) is odd
+static bool csv_quote_parity(const char *p, const char *end, char quote_char) {
+    size_t count = 0;
+    while ((p = memchr(p, quote_char, end - p)) != NULL) {
+        count++;
+        p++;
+    }
+    return count & 1;
+}
+
+// Find the first record that starts at or after chunk->begin
+static const char* csv_chunk_first_record(CSVChunkQueue *queue, CSVChunk *chunk) {
+    const char *p = chunk->begin;
+    
+    if (p == chunk->end || p == queue->chunks[0].begin) return p;
+    
+    // A line break right before the chunk ends the previous record
+    if ((p[-1] == '\n' || p[-1] == '\r') && !chunk->starts_in_quotes) return p;
+    
+    CSVScanner scanner;
+    csv_scanner_init(&scanner, queue->delimiter, queue->quote_char,
+                     p, chunk->end - p);
+    scanner.in_quotes = chunk->starts_in_quotes ? ~0ULL : 0;
+    scanner.field_start = p[-1] == queue->delimiter || p[-1] == queue->quote_char;
+    
+    const char *s;
+    do {
+        s = csv_scanner_next(&scanner);
+    } while (s < chunk->end && *s == queue->delimiter);
+    
+    chunk->stray_quotes = scanner.stray_quotes;
+    return s < chunk->end ? s + 1 : s;
+}
+
+static void csv_parse_chunk(CSVChunkQueue *queue, CSVChunk *chunk) {
+    if (chunk->rows) csv_free(chunk->rows);
+    chunk->rows = csv_init_arena(queue->delimiter, queue->quote_char);
+    if (!chunk->rows) {
+        chunk->ok = false;
+        return;
+    }
+    
+    const char *start = csv_chunk_first_record(queue, chunk);
+    bool stray_quotes = false;
+    chunk->ok = start >= chunk->limit ||
+                csv_parse_range(chunk->rows, start, chunk->limit, chunk->end, false,
+                                &stray_quotes);
+    chunk->stray_quotes |= stray_quotes;
+}
+
+// Pool worker: take chunks off the queue until it is empty
+static void* csv_chunk_worker(void *arg) {
+    CSVChunkQueue *queue = (CSVChunkQueue*)arg;
+    size_t i;
+    
+    while ((i = atomic_fetch_add(&queue->next_chunk, 1)) < queue->chunk_count) {
+        CSVChunk *chunk = &queue->chunks[i];
+        if (!chunk->needs_parse) continue;
+        
+        if (!chunk->rows) {
+            chunk->quote_parity = csv_quote_parity(chunk->begin, chunk->limit,
+                                                   queue->quote_char);
+        }
+        csv_parse_chunk(queue, chunk);
+        chunk->needs_parse = false;
+    }
+    
+    return NULL;
+}
+
+// Run the queue on num_threads threads (the caller is one of them). If the
+// thread handles cannot be allocated the caller works through it alone.
+static void csv_run_chunk_queue(CSVChunkQueue *queue, int num_threads) {
+    pthread_t *threads = num_threads > 1 ?
+        (pthread_t*)malloc((size_t)(num_threads - 1) * sizeof(pthread_t)) : NULL;
+    int started = 0;
+    
+    atomic_store(&queue->next_chunk, 0);
+    for (int i = 1; threads && i < num_threads; i++) {
+        if (pthread_create(&threads[started], NULL, csv_chunk_worker, queue) == 0) {
+            started++;
+        }
+    }
+    
+    csv_chunk_worker(queue);
+    
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+}
+
+// Move every chunk's rows, in order, into csv
+static bool csv_stitch_chunks(CSVData *csv, CSVChunk *chunks, size_t chunk_count) {
+    size_t total = 0;
+    for (size_t i = 0; i < chunk_count; i++) {
+        total += chunks[i].rows->row_count;
+    }
+    
+    if (total > 0) {
+        csv->rows = (CSVRow*)malloc(total * sizeof(CSVRow));
+        if (!csv->rows) return false;
+        csv->capacity = total;
+    }
+    
+    for (size_t i = 0; i < chunk_count; i++) {
+        CSVData *part = chunks[i].rows;
+        if (part->row_count > 0) {
+            memcpy(&csv->rows[csv->row_count], part->rows,
+                   part->row_count * sizeof(CSVRow));
+            csv->row_count += part->row_count;
+        }
+        
+        // The fields now belong to csv
+        csv_arena_merge(&csv->arena, &part->arena);
+        free(part->rows);
+        free(part);
+        chunks[i].rows = NULL;
+    }
+    
+    return true;
+}
+
+// Parse CSV file on num_threads threads (0 = one per online CPU). Fields are
+// views into a file mapping, as with csv_parse_file_mmap.
+CSVData* csv_parse_file_parallel(const char *filename, char delimiter,
+                                 char quote_char, int num_threads) {
+    CSVData *csv = csv_init_arena(delimiter, quote_char);
+    if (!csv) return NULL;
+    
+    if (!csv_map_file(csv, filename)) {
+        csv_free(csv);
+        return NULL;
+    }
+    
+    if (num_threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = cpus > 0 ? (int)cpus : 1;
+    }
+    
+    const char *buf = (const char*)csv->mapping;
+    size_t size = csv->mapping_size;
+    size_t chunk_count = (size_t)num_threads * CSV_CHUNKS_PER_THREAD;
+    if (size / chunk_count < CSV_MIN_CHUNK_SIZE) {
+        chunk_count = size / CSV_MIN_CHUNK_SIZE;
+    }
+    
+    // Not worth splitting
+    if (num_threads == 1 || chunk_count <= 1) {
+        if (!csv_parse_buffer(csv, buf, size)) {
+            fprintf(stderr, "Error parsing file\n");
+            csv_free(csv);
+            return NULL;
+        }
+        return csv;
+    }
+    
+    // Threads beyond one per chunk would find nothing to do
+    if ((size_t)num_threads > chunk_count) num_threads = (int)chunk_count;
+    
+    CSVChunk *chunks = (CSVChunk*)calloc(chunk_count, sizeof(CSVChunk));
+    if (!chunks) {
+        csv_free(csv);
+        return NULL;
+    }
+    
+    size_t chunk_size = size / chunk_count;
+    for (size_t i = 0; i < chunk_count; i++) {
+        chunks[i].begin = buf + i * chunk_size;
+        chunks[i].limit = i + 1 < chunk_count ? chunks[i].begin + chunk_size
+                                              : buf + size;
+        chunks[i].end = buf + size;
+        chunks[i].needs_parse = true;
+    }
+    
+    CSVChunkQueue queue = {
+        .chunks = chunks,
+        .chunk_count = chunk_count,
+        .delimiter = csv->delimiter,
+        .quote_char = csv->quote_char
+    };
+    
+    // Pass 1: speculate that no chunk starts inside quotes
+    csv_run_chunk_queue(&queue, num_threads);
+    
+    // Pass 2: reparse the chunks whose speculation was wrong
+    bool in_quotes = false;
+    bool reparse = false;
+    for (size_t i = 0; i < chunk_count; i++) {
+        if (chunks[i].starts_in_quotes != in_quotes) {
+            chunks[i].starts_in_quotes = in_quotes;
+            chunks[i].needs_parse = true;
+            reparse = true;
+        }
+        in_quotes ^= chunks[i].quote_parity;
+    }
+    if (reparse) {
+        csv_run_chunk_queue(&queue, num_threads);
+    }
+    
+    bool ok = true;
+    bool stray_quotes = false;
+    for (size_t i = 0; i < chunk_count; i++) {
+        ok = ok && chunks[i].ok;
+        stray_quotes = stray_quotes || chunks[i].stray_quotes;
+    }
+    
+    if (ok && stray_quotes) {
+        // The chunks' starting states came from parities that do not hold
+        for (size_t i = 0; i < chunk_count; i++) {
+            csv_free(chunks[i].rows);
+            chunks[i].rows = NULL;
+        }
+        ok = csv_parse_buffer(csv, buf, size);
+    } else {
+        ok = ok && csv_stitch_chunks(csv, chunks, chunk_count);
+    }
+    
+    if (!ok) {
+        fprintf(stderr, "Error parsing file\n");
+        for (size_t i = 0; i < chunk_count; i++) {
+            csv_free(chunks[i].rows);
+        }
+        free(chunks);
+        csv_free(csv);
+        return NULL;
+    }
+    
+    free(chunks);
+    return csv;
+}
+
+// Parse CSV from a length-delimited buffer (need not be NUL-terminated).
+// Records are tokenized in place in a single pass and their fields copied
+// into the result's arena, so the buffer can be released afterwards.
+CSVData* csv_parse_string_n(const char *data, size_t length, char delimiter,
+                            char quote_char) {
+    CSVData *csv = csv_init_arena(delimiter, quote_char);
+    if (!csv) return NULL;
+    
+    if (!csv_parse_range(csv, data, data + length, data + length, true, NULL)) {
+        csv_free(csv);
+        return NULL;
+    }
+    
+    return csv;
+}
+
+// Parse CSV from string
+CSVData* csv_parse_string(const char *str, char delimiter, char quote_char) {
+    return csv_parse_string_n(str, strlen(str), delimiter, quote_char);
+}
+
+// Get field value (not NUL-terminated for data from csv_parse_file_mmap)
+const char* csv_get_field(CSVData *csv, size_t row, size_t col) {
+    if (!csv || row >= csv->row_count) return NULL;
+    if (col >= csv->rows[row].field_count) return NULL;
+    return csv->rows[row].fields[col].data;
+}
+
+// Get field value and its length; works for copied and mapped fields alike
+const char* csv_get_field_view(CSVData *csv, size_t row, size_t col, size_t *length) {
+    if (!csv || row >= csv->row_count) return NULL;
+    if (col >= csv->rows[row].field_count) return NULL;
+    if (length) *length = csv->rows[row].fields[col].length;
+    return csv->rows[row].fields[col].data;
+}
+
+// Print CSV data
+void csv_print(CSVData *csv) {
+    if (!csv) return;
+    
+    printf("CSV Data (%zu rows):\n", csv->row_count);
+    for (size_t i = 0; i < csv->row_count; i++) {
+        printf("Row %zu: ", i);
+        for (size_t j = 0; j < csv->rows[i].field_count; j++) {
+            printf("[%.*s]", (int)csv->rows[i].fields[j].length,
+                   csv->rows[i].fields[j].data);
+            if (j < csv->rows[i].field_count - 1) {
+                printf(" ");
+            }
+        }
+        printf("\n");
+    }
+}
+
+// Buffered writer
+//
+// Output is assembled in one large buffer and written with few syscalls.
+// Fields are checked for characters that force quoting with the same block
+// classifier as the tokenizer, and unquoted fields are copied in bulk. A
+// field too large for the buffer is written together with the buffered
+// bytes in a single writev instead of being copied. With direct_io the file
+// is opened O_DIRECT and written in whole aligned blocks.
+#define CSV_WRITE_BUFFER (1 << 20)
+#define CSV_DIRECT_ALIGN 4096
+
+typedef struct {
+    size_t buffer_size;     // 0 = CSV_WRITE_BUFFER
+    bool direct_io;         // Bypass the page cache where supported
+} CSVWriteOptions;
+
+typedef struct {
+    int fd;
+    char *buf;
+    size_t used;
+    size_t size;
+    bool direct;
+    bool error;
+    char delimiter;
+    char quote_char;
+    CSVStructuralFn find_structurals;
+} CSVWriter;
+
+// write() until everything is out
+static bool csv_write_all(int fd, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(fd, data, length);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        length -= n;
+    }
+    return true;
+}
+
+// Write out the buffer. With O_DIRECT only whole blocks can be written, so
+// the remainder stays buffered until the final flush, which writes the tail
+// through the page cache.
+static bool csv_writer_flush(CSVWriter *writer, bool final) {
+    size_t length = writer->used;
+    
+#ifdef O_DIRECT
+    if (writer->direct && !final) {
+        length -= length % CSV_DIRECT_ALIGN;
+    } else if (writer->direct && length % CSV_DIRECT_ALIGN) {
+        int flags = fcntl(writer->fd, F_GETFL);
+        fcntl(writer->fd, F_SETFL, flags & ~O_DIRECT);
+        writer->direct = false;
+    }
+#endif
+    
+    if (!csv_write_all(writer->fd, writer->buf, length)) {
+        writer->error = true;
+        return false;
+    }
+    
+    memmove(writer->buf, writer->buf + length, writer->used - length);
+    writer->used -= length;
+    return true;
+}
+
+// Write the buffer and a large field in one syscall
+static bool csv_writer_flush_with(CSVWriter *writer, const char *data, size_t length) {
+    struct iovec iov[2] = {
+        { writer->buf, writer->used },
+        { (void*)data, length }
+    };
+    
+    ssize_t n;
+    do {
+        n = writev(writer->fd, iov, 2);
+    } while (n < 0 && errno == EINTR);
+    
+    bool ok = n >= 0;
+    if (ok && (size_t)n < writer->used) {
+        ok = csv_write_all(writer->fd, writer->buf + n, writer->used - n) &&
+             csv_write_all(writer->fd, data, length);
+    } else if (ok && (size_t)n < writer->used + length) {
+        size_t done = n - writer->used;
+        ok = csv_write_all(writer->fd, data + done, length - done);
+    }
+    
+    writer->used = 0;
+    if (!ok) writer->error = true;
+    return ok;
+}
+
+// Append bytes to the output
+static void csv_writer_put(CSVWriter *writer, const char *data, size_t length) {
+    if (writer->error) return;
+    
+    if (length > writer->size - writer->used) {
+        if (!writer->direct && length >= writer->size) {
+            csv_writer_flush_with(writer, data, length);
+            return;
+        }
+        
+        // Fill, flush, repeat
+        while (length > writer->size - writer->used) {
+            size_t n = writer->size - writer->used;
+            memcpy(writer->buf + writer->used, data, n);
+            writer->used += n;
+            data += n;
+            length -= n;
+            if (!csv_writer_flush(writer, false)) return;
+        }
+    }
+    
+    memcpy(writer->buf + writer->used, data, length);
+    writer->used += length;
+}
+
+static void csv_writer_putc(CSVWriter *writer, char c) {
+    if (writer->used == writer->size && !csv_writer_flush(writer, false)) return;
+    writer->buf[writer->used++] = c;
+}
+
+// Does a field contain a delimiter, quote or line break?
+static bool csv_writer_needs_quotes(const CSVWriter *writer, const char *data,
+                                    size_t length) {
+    CSVBlockMasks masks;
+    size_t i = 0;
+    
+    for (; i + CSV_BLOCK_SIZE <= length; i += CSV_BLOCK_SIZE) {
+        writer->find_structurals(data + i, writer->delimiter, writer->quote_char, &masks);
+        if (masks.delimiter | masks.quote | masks.newline) return true;
+    }
+    
+    // Short tails are cheaper to check one byte at a time than to pad
+    if (length - i >= 16) {
+        char tail[CSV_BLOCK_SIZE] = {0};
+        memcpy(tail, data + i, length - i);
+        writer->find_structurals(tail, writer->delimiter, writer->quote_char, &masks);
+        return (masks.delimiter | masks.quote | masks.newline) != 0;
+    }
+    
+    for (; i < length; i++) {
+        char c = data[i];
+        if (c == writer->delimiter || c == writer->quote_char || c == '\n' || c == '\r') {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Open a buffered writer (options may be NULL)
+CSVWriter* csv_writer_open(const char *filename, char delimiter, char quote_char,
+                           const CSVWriteOptions *options) {
+    CSVWriter *writer = (CSVWriter*)calloc(1, sizeof(CSVWriter));
+    if (!writer) return NULL;
+    
+    writer->size = options && options->buffer_size ? options->buffer_size
+                                                   : CSV_WRITE_BUFFER;
+    writer->delimiter = delimiter ? delimiter : ',';
+    writer->quote_char = quote_char ? quote_char : '"';
+    writer->find_structurals = csv_select_structural_fn();
+    writer->fd = -1;
+    
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+    if (options && options->direct_io) {
+        // Whole blocks only, from an aligned buffer
+        writer->size = (writer->size + CSV_DIRECT_ALIGN - 1) & ~(size_t)(CSV_DIRECT_ALIGN - 1);
+        writer->fd = open(filename, flags | O_DIRECT, 0644);
+        writer->direct = writer->fd >= 0;
+    }
+#endif
+    if (writer->fd < 0) {
+        writer->fd = open(filename, flags, 0644);
+    }
+    if (writer->fd < 0) {
+        free(writer);
+        return NULL;
+    }
+    
+    if (writer->direct) {
+        void *buf = NULL;
+        if (posix_memalign(&buf, CSV_DIRECT_ALIGN, writer->size) == 0) {
+            writer->buf = (char*)buf;
+        }
+    } else {
+        writer->buf = (char*)malloc(writer->size);
+    }
+    if (!writer->buf) {
+        close(writer->fd);
+        free(writer);
+        return NULL;
+    }
+    
+    return writer;
+}
+
+// Write one record
+bool csv_writer_write_row(CSVWriter *writer, const CSVRow *row) {
+    for (size_t j = 0; j < row->field_count; j++) {
+        const char *field = row->fields[j].data;
+        size_t length = row->fields[j].length;
+        
+        if (csv_writer_needs_quotes(writer, field, length)) {
+            // Copy the runs between quotes, doubling each quote
+            const char *p = field;
+            const char *end = field + length;
+            const char *quote;
+            
+            csv_writer_putc(writer, writer->quote_char);
+            while ((quote = memchr(p, writer->quote_char, end - p)) != NULL) {
+                csv_writer_put(writer, p, quote + 1 - p);
+                csv_writer_putc(writer, writer->quote_char); // Escape quote
+                p = quote + 1;
+            }
+            csv_writer_put(writer, p, end - p);
+            csv_writer_putc(writer, writer->quote_char);
+        } else {
+            csv_writer_put(writer, field, length);
+        }
+        
+        if (j < row->field_count - 1) {
+            csv_writer_putc(writer, writer->delimiter);
+        }
+    }
+    csv_writer_putc(writer, '\n');
+    
+    return !writer->error;
+}
+
+// Flush and close a writer; false if anything failed to be written
+bool csv_writer_close(CSVWriter *writer) {
+    if (!writer) return false;
+    
+    if (!writer->error) csv_writer_flush(writer, true);
+    bool ok = !writer->error;
+    
+    if (close(writer->fd) < 0) ok = false;
+    free(writer->buf);
+    free(writer);
+    return ok;
+}
+
+// Write CSV to file with explicit writer options (may be NULL)
+bool csv_write_file_ex(CSVData *csv, const char *filename,
+                       const CSVWriteOptions *options) {
+    CSVWriter *writer = csv_writer_open(filename, csv->delimiter, csv->quote_char,
+                                        options);
+    if (!writer) return false;
+    
+    for (size_t i = 0; i < csv->row_count; i++) {
+        if (!csv_writer_write_row(writer, &csv->rows[i])) break;
+    }
+    
+    return csv_writer_close(writer);
+}
+
+// Write CSV to file
+bool csv_write_file(CSVData *csv, const char *filename) {
+    return csv_write_file_ex(csv, filename, NULL);
+}
+
+// Header index: open-addressing hash from column name to column index,
+// built once so name lookups don't strcmp every header
+typedef struct {
+    const char *name;       // Owner's copy of the name; NULL = empty slot
+    uint64_t hash;
+    size_t column;
+} CSVHeaderSlot;
+
+typedef struct {
+    CSVHeaderSlot *slots;
+    size_t mask;            // Slot count - 1 (a power of two)
+} CSVHeaderIndex;
+
+// Resolved column, for loops that access the same column on every row
+typedef size_t CSVColumnHandle;
+#define CSV_NO_COLUMN ((size_t)-1)
+
+// FNV-1a
+static uint64_t csv_hash_name(const char *name) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char*)name; *p; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Allocate an index for count names (load factor at most 1/2)
+static bool csv_header_index_init(CSVHeaderIndex *index, size_t count) {
+    size_t slot_count = 8;
+    while (slot_count < count * 2) slot_count *= 2;
+    
+    index->slots = (CSVHeaderSlot*)calloc(slot_count, sizeof(CSVHeaderSlot));
+    if (!index->slots) return false;
+    index->mask = slot_count - 1;
+    return true;
+}
+
+// Probe for name; returns its slot, or the empty slot where it belongs
+static CSVHeaderSlot* csv_header_index_probe(const CSVHeaderIndex *index,
+                                             const char *name, uint64_t hash) {
+    size_t i = hash & index->mask;
+    while (index->slots[i].name) {
+        if (index->slots[i].hash == hash && strcmp(index->slots[i].name, name) == 0) {
+            break;
+        }
+        i = (i + 1) & index->mask;
+    }
+    return &index->slots[i];
+}
+
+// Add a column name; the first of duplicate names wins
+static void csv_header_index_add(CSVHeaderIndex *index, const char *name, size_t column) {
+    uint64_t hash = csv_hash_name(name);
+    CSVHeaderSlot *slot = csv_header_index_probe(index, name, hash);
+    if (!slot->name) {
+        slot->name = name;
+        slot->hash = hash;
+        slot->column = column;
+    }
+}
+
+// Look up a column name; CSV_NO_COLUMN if absent
+static CSVColumnHandle csv_header_index_find(const CSVHeaderIndex *index, const char *name) {
+    if (!index->slots) return CSV_NO_COLUMN;
+    CSVHeaderSlot *slot = csv_header_index_probe(index, name, csv_hash_name(name));
+    return slot->name ? slot->column : CSV_NO_COLUMN;
+}
+
+// Advanced CSV parser with header support
+typedef struct {
+    CSVData *data;
+    char **headers;
+    size_t header_count;
+    CSVHeaderIndex index;   // Header name -> column
+} CSVTable;
+
+CSVTable* csv_parse_with_headers(const char *filename, char delimiter, char quote_char) {
+    CSVData *data = csv_parse_file(filename, delimiter, quote_char);
+    if (!data || data->row_count == 0) return NULL;
+    
+    CSVTable *table = (CSVTable*)malloc(sizeof(CSVTable));
+    if (!table) {
+        csv_free(data);
+        return NULL;
+    }
+    
+    // First row as headers
+    table->header_count = data->rows[0].field_count;
+    table->headers = (char**)malloc(table->header_count * sizeof(char*));
+    if (!table->headers) {
+        free(table);
+        csv_free(data);
+        return NULL;
+    }
+    
+    // Copy headers
+    for (size_t i = 0; i < table->header_count; i++) {
+        table->headers[i] = strndup(data->rows[0].fields[i].data,
+                                    data->rows[0].fields[i].length);
+    }
+    
+    // Index them by name
+    if (!csv_header_index_init(&table->index, table->header_count)) {
+        for (size_t i = 0; i < table->header_count; i++) {
+            free(table->headers[i]);
+        }
+        free(table->headers);
+        free(table);
+        csv_free(data);
+        return NULL;
+    }
+    for (size_t i = 0; i < table->header_count; i++) {
+        if (table->headers[i]) {
+            csv_header_index_add(&table->index, table->headers[i], i);
+        }
+    }
+    
+    // Remove header row from data
+    csv_free_row(&data->rows[0]);
+    memmove(&data->rows[0], &data->rows[1], 
+            (data->row_count - 1) * sizeof(CSVRow));
+    data->row_count--;
+    
+    table->data = data;
+    return table;
+}
+
+// Get field by header name
+const char* csv_get_field_by_name(CSVTable *table, size_t row, const char *header) {
+    if (!table || !header) return NULL;
+    
+    CSVColumnHandle col = csv_header_index_find(&table->index, header);
+    if (col == CSV_NO_COLUMN) return NULL;
+    return csv_get_field(table->data, row, col);
+}
+
+// Resolve a header name once, for use with csv_get_field_by_handle
+CSVColumnHandle csv_table_column(CSVTable *table, const char *header) {
+    if (!table || !header) return CSV_NO_COLUMN;
+    return csv_header_index_find(&table->index, header);
+}
+
+// Get field through a resolved column handle
+const char* csv_get_field_by_handle(CSVTable *table, size_t row, CSVColumnHandle col) {
+    if (!table || row >= table->data->row_count) return NULL;
+    if (col >= table->data->rows[row].field_count) return NULL;
+    return table->data->rows[row].fields[col].data;
+}
+
+// Free CSV table
+void csv_table_free(CSVTable *table) {
+    if (table) {
+        for (size_t i = 0; i < table->header_count; i++) {
+            free(table->headers[i]);
+        }
+        free(table->headers);
+        free(table->index.slots);
+        csv_free(table->data);
+        free(table);
+    }
+}
+
+// Columnar storage
+//
+// An alternative to CSVTable for column scans. Every column keeps its own
+// memory: string columns are one contiguous arena plus row offsets, and
+// columns whose non-empty values are all integers, numbers or booleans are
+// stored as packed native arrays. Empty or missing fields are null, tracked
+// in a per-column bitmap.
+typedef enum {
+    CSV_TYPE_STRING,
+    CSV_TYPE_INT64,
+    CSV_TYPE_DOUBLE,
+    CSV_TYPE_BOOL
+} CSVColumnType;
+
+typedef struct {
+    char *name;
+    CSVColumnType type;
+    char *arena;            // String column: all values back to back
+    size_t arena_size;
+    uint64_t *offsets;      // String column: row i is arena[offsets[i], offsets[i + 1])
+    union {
+        int64_t *ints;
+        double *doubles;
+        uint8_t *bools;
+    } values;               // Typed column: one value per row (0 when null)
+    uint64_t *nulls;        // Bit i set when row i is null
+} CSVColumn;
+
+typedef struct {
+    CSVColumn *columns;
+    size_t column_count;
+    size_t row_count;
+    CSVHeaderIndex index;   // Column name -> column
+    void *mapping;          // Cache file the columns point into (read-only)
+    size_t mapping_size;
+} CSVColumnarTable;
+
+// Per-column state while the table is being built
+typedef struct {
+    size_t arena_capacity;
+    bool maybe_int;
+    bool maybe_double;
+    bool maybe_bool;
+    bool has_values;
+} CSVColumnBuilder;
+
+#define CSV_NULL_WORDS(rows) (((rows) + 63) / 64)
+
+// Parse a whole field as a base-10 int64
+static bool csv_parse_int64(const char *data, size_t length, int64_t *out) {
+    size_t i = 0;
+    bool negative = false;
+    uint64_t value = 0;
+    
+    if (i < length && (data[i] == '-' || data[i] == '+')) {
+        negative = data[i] == '-';
+        i++;
+    }
+    if (i == length) return false;
+    
+    for (; i < length; i++) {
+        if (data[i] < '0' || data[i] > '9') return false;
+        uint64_t digit = data[i] - '0';
+        if (value > (UINT64_MAX - digit) / 10) return false;
+        value = value * 10 + digit;
+    }
+    
+    if (negative ? value > (uint64_t)INT64_MAX + 1 : value > INT64_MAX) return false;
+    *out = negative ? (int64_t)(0 - value) : (int64_t)value;
+    return true;
+}
+
+// Parse a whole field as a double
+static bool csv_parse_double(const char *data, size_t length, double *out) {
+    char buf[64];
+    if (length == 0 || length >= sizeof(buf)) return false;
+    
+    memcpy(buf, data, length);
+    buf[length] = '\0';
+    
+    char *end;
+    *out = strtod(buf, &end);
+    return end == buf + length && !isspace((unsigned char)buf[0]);
+}
+
+// Parse a whole field as true/false (any case)
+static bool csv_parse_bool(const char *data, size_t length, uint8_t *out) {
+    if (length == 4 && strncasecmp(data, "true", 4) == 0) {
+        *out = 1;
+        return true;
+    }
+    if (length == 5 && strncasecmp(data, "false", 5) == 0) {
+        *out = 0;
+        return true;
+    }
+    return false;
+}
+
+// Grow every column's offsets and null bitmap to hold new_capacity rows
+static bool csv_columnar_reserve(CSVColumnarTable *table, size_t new_capacity) {
+    for (size_t j = 0; j < table->column_count; j++) {
+        CSVColumn *col = &table->columns[j];
+        
+        uint64_t *offsets = (uint64_t*)realloc(col->offsets,
+                                               (new_capacity + 1) * sizeof(uint64_t));
+        if (!offsets) return false;
+        col->offsets = offsets;
+        
+        size_t old_words = CSV_NULL_WORDS(table->row_count);
+        size_t new_words = CSV_NULL_WORDS(new_capacity);
+        uint64_t *nulls = (uint64_t*)realloc(col->nulls, new_words * sizeof(uint64_t));
+        if (!nulls) return false;
+        memset(nulls + old_words, 0, (new_words - old_words) * sizeof(uint64_t));
+        col->nulls = nulls;
+    }
+    return true;
+}
+
+// Append one value to a column's string arena and update its type guess
+static bool csv_column_append(CSVColumn *col, CSVColumnBuilder *builder,
+                              size_t row, const char *data, size_t length) {
+    if (length == 0) {
+        col->offsets[row + 1] = col->arena_size;
+        col->nulls[row / 64] |= 1ULL << (row % 64);
+        return true;
+    }
+    
+    if (col->arena_size + length > builder->arena_capacity) {
+        size_t new_capacity = builder->arena_capacity == 0 ? 256
+                                                          : builder->arena_capacity * 2;
+        while (new_capacity < col->arena_size + length) new_capacity *= 2;
+        
+        char *arena = (char*)realloc(col->arena, new_capacity);
+        if (!arena) return false;
+        col->arena = arena;
+        builder->arena_capacity = new_capacity;
+    }
+    
+    memcpy(col->arena + col->arena_size, data, length);
+    col->arena_size += length;
+    col->offsets[row + 1] = col->arena_size;
+    
+    int64_t i;
+    double d;
+    uint8_t b;
+    builder->has_values = true;
+    if (builder->maybe_int) builder->maybe_int = csv_parse_int64(data, length, &i);
+    if (builder->maybe_double) builder->maybe_double = csv_parse_double(data, length, &d);
+    if (builder->maybe_bool) builder->maybe_bool = csv_parse_bool(data, length, &b);
+    
+    return true;
+}
+
+// Replace a string column by the packed array of its inferred type
+static bool csv_column_convert(CSVColumn *col, const CSVColumnBuilder *builder,
+                               size_t row_count) {
+    if (!builder->has_values) return true;
+    
+    if (builder->maybe_bool) col->type = CSV_TYPE_BOOL;
+    else if (builder->maybe_int) col->type = CSV_TYPE_INT64;
+    else if (builder->maybe_double) col->type = CSV_TYPE_DOUBLE;
+    else return true;
+    
+    size_t width = col->type == CSV_TYPE_BOOL ? sizeof(uint8_t)
+                 : col->type == CSV_TYPE_INT64 ? sizeof(int64_t) : sizeof(double);
+    void *values = calloc(row_count ? row_count : 1, width);
+    if (!values) return false;
+    
+    for (size_t r = 0; r < row_count; r++) {
+        const char *data = col->arena + col->offsets[r];
+        size_t length = col->offsets[r + 1] - col->offsets[r];
+        if (length == 0) continue;
+        
+        switch (col->type) {
+            case CSV_TYPE_BOOL:
+                csv_parse_bool(data, length, &((uint8_t*)values)[r]);
+                break;
+            case CSV_TYPE_INT64:
+                csv_parse_int64(data, length, &((int64_t*)values)[r]);
+                break;
+            case CSV_TYPE_DOUBLE:
+                csv_parse_double(data, length, &((double*)values)[r]);
+                break;
+            default:
+                break;
+        }
+    }
+    
+    free(col->arena);
+    free(col->offsets);
+    col->arena = NULL;
+    col->arena_size = 0;
+    col->offsets = NULL;
+    col->values.ints = (int64_t*)values;
+    
+    return true;
+}
+
+// Free columnar table
+void csv_columnar_free(CSVColumnarTable *table) {
+    if (table) {
+        for (size_t j = 0; j < table->column_count && !table->mapping; j++) {
+            CSVColumn *col = &table->columns[j];
+            free(col->name);
+            free(col->arena);
+            free(col->offsets);
+            free(col->values.ints);
+            free(col->nulls);
+        }
+        if (table->mapping) munmap(table->mapping, table->mapping_size);
+        free(table->columns);
+        free(table->index.slots);
+        free(table);
+    }
+}
+
+// Parse a CSV file with a header row straight into columnar storage. Rows
+// are streamed, so the row-major form never exists in memory.
+CSVColumnarTable* csv_parse_columnar(const char *filename, char delimiter, char quote_char) {
+    CSVReader *reader = csv_reader_open(filename, delimiter, quote_char, 0);
+    if (!reader) return NULL;
+    
+    CSVColumnarTable *table = NULL;
+    CSVColumnBuilder *builders = NULL;
+    size_t row_capacity = 0;
+    
+    const CSVRow *row = csv_reader_next(reader);
+    if (!row) goto fail;
+    
+    // First row as column names
+    table = (CSVColumnarTable*)calloc(1, sizeof(CSVColumnarTable));
+    if (!table) goto fail;
+    table->columns = (CSVColumn*)calloc(row->field_count, sizeof(CSVColumn));
+    builders = (CSVColumnBuilder*)calloc(row->field_count, sizeof(CSVColumnBuilder));
+    if (!table->columns || !builders) goto fail;
+    
+    table->column_count = row->field_count;
+    for (size_t j = 0; j < table->column_count; j++) {
+        table->columns[j].name = strndup(row->fields[j].data, row->fields[j].length);
+        if (!table->columns[j].name) goto fail;
+        table->columns[j].type = CSV_TYPE_STRING;
+        builders[j].maybe_int = true;
+        builders[j].maybe_double = true;
+        builders[j].maybe_bool = true;
+    }
+    
+    if (!csv_header_index_init(&table->index, table->column_count)) goto fail;
+    for (size_t j = 0; j < table->column_count; j++) {
+        csv_header_index_add(&table->index, table->columns[j].name, j);
+    }
+    
+    if (!csv_columnar_reserve(table, 64)) goto fail;
+    row_capacity = 64;
+    for (size_t j = 0; j < table->column_count; j++) {
+        table->columns[j].offsets[0] = 0;
+    }
+    
+    while ((row = csv_reader_next(reader)) != NULL) {
+        size_t r = table->row_count;
+        if (r == row_capacity) {
+            if (!csv_columnar_reserve(table, row_capacity * 2)) goto fail;
+            row_capacity *= 2;
+        }
+        
+        // Missing trailing fields become nulls; extra fields are ignored
+        for (size_t j = 0; j < table->column_count; j++) {
+            const char *data = j < row->field_count ? row->fields[j].data : "";
+            size_t length = j < row->field_count ? row->fields[j].length : 0;
+            if (!csv_column_append(&table->columns[j], &builders[j], r, data, length)) {
+                goto fail;
+            }
+        }
+        table->row_count++;
+    }
+    if (reader->error) goto fail;
+    
+    for (size_t j = 0; j < table->column_count; j++) {
+        if (!csv_column_convert(&table->columns[j], &builders[j], table->row_count)) {
+            goto fail;
+        }
+    }
+    
+    free(builders);
+    csv_reader_close(reader);
+    return table;
+    
+fail:
+    fprintf(stderr, "Error parsing file: %s\n", filename);
+    free(builders);
+    csv_columnar_free(table);
+    csv_reader_close(reader);
+    return NULL;
+}
+
+// Find a column by name
+const CSVColumn* csv_columnar_find(const CSVColumnarTable *table, const char *name) {
+    if (!table || !name) return NULL;
+    
+    CSVColumnHandle col = csv_header_index_find(&table->index, name);
+    return col == CSV_NO_COLUMN ? NULL : &table->columns[col];
+}
+
+// Is a column's value in a row null?
+bool csv_column_is_null(const CSVColumn *col, size_t row) {
+    return (col->nulls[row / 64] >> (row % 64)) & 1;
+}
+
+// Get a string column's value (not NUL-terminated)
+const char* csv_column_string(const CSVColumn *col, size_t row, size_t *length) {
+    if (col->type != CSV_TYPE_STRING) return NULL;
+    if (length) *length = col->offsets[row + 1] - col->offsets[row];
+    return col->arena ? col->arena + col->offsets[row] : "";
+}
+
+// Columnar cache
+//
+// A columnar table saved to disk in a layout that loads with one mmap: a
+// header, a descriptor per column, then every array (names, null bitmaps,
+// string offsets and arenas, typed values) 8-byte aligned. The header
+// records the source file's size and mtime plus the dialect, and a cache
+// that no longer matches them is ignored. Numbers are stored in native
+// byte order; a cache from a machine with the other order is rejected.
+#define CSV_CACHE_MAGIC "CSVCACHE"
+#define CSV_CACHE_VERSION 1
+#define CSV_CACHE_BYTE_ORDER 0x01020304u
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t file_size;         // Of the cache file itself
+    uint64_t source_size;
+    int64_t source_mtime_sec;
+    int64_t source_mtime_nsec;
+    uint64_t column_count;
+    uint64_t row_count;
+    char delimiter;
+    char quote_char;
+    char reserved[6];
+} CSVCacheHeader;
+
+typedef struct {
+    uint32_t type;              // CSVColumnType
+    uint32_t reserved;
+    uint64_t name_offset;       // NUL-terminated
+    uint64_t name_length;
+    uint64_t nulls_offset;      // CSV_NULL_WORDS(row_count) words
+    uint64_t offsets_offset;    // String columns: row_count + 1 offsets
+    uint64_t data_offset;       // String arena or packed values
+    uint64_t data_size;
+} CSVCacheColumn;
+
+#define CSV_CACHE_ALIGN(n) (((n) + 7) & ~(uint64_t)7)
+
+// Bytes of packed values (or string arena) a column stores
+static uint64_t csv_cache_data_size(const CSVColumn *col, size_t row_count) {
+    switch (col->type) {
+        case CSV_TYPE_INT64: return row_count * sizeof(int64_t);
+        case CSV_TYPE_DOUBLE: return row_count * sizeof(double);
+        case CSV_TYPE_BOOL: return row_count * sizeof(uint8_t);
+        default: return col->arena_size;
+    }
+}
+
+static bool csv_cache_key(const char *source_path, CSVCacheHeader *header) {
+    struct stat st;
+    if (stat(source_path, &st) != 0) return false;
+    header->source_size = st.st_size;
+    header->source_mtime_sec = st.st_mtim.tv_sec;
+    header->source_mtime_nsec = st.st_mtim.tv_nsec;
+    return true;
+}
+
+// Write bytes followed by zero padding up to the next 8-byte boundary
+static bool csv_cache_put(FILE *file, const void *data, uint64_t size) {
+    static const char padding[8] = {0};
+    if (size > 0 && fwrite(data, 1, size, file) != size) return false;
+    uint64_t pad = CSV_CACHE_ALIGN(size) - size;
+    return pad == 0 || fwrite(padding, 1, pad, file) == pad;
+}
+
+// Save a columnar table parsed from source_path (with the given dialect)
+// to cache_path. The file is written under a temporary name and renamed,
+// so readers never see a partial cache.
+bool csv_columnar_save(const CSVColumnarTable *table, const char *cache_path,
+                       const char *source_path, char delimiter, char quote_char) {
+    CSVCacheHeader header = {0};
+    memcpy(header.magic, CSV_CACHE_MAGIC, sizeof(header.magic));
+    header.version = CSV_CACHE_VERSION;
+    header.byte_order = CSV_CACHE_BYTE_ORDER;
+    header.column_count = table->column_count;
+    header.row_count = table->row_count;
+    header.delimiter = delimiter;
+    header.quote_char = quote_char;
+    if (!csv_cache_key(source_path, &header)) return false;
+    
+    CSVCacheColumn *descs = (CSVCacheColumn*)calloc(table->column_count ? table->column_count : 1,
+                                                    sizeof(CSVCacheColumn));
+    if (!descs) return false;
+    
+    // Lay the arrays out in the order they are written below
+    uint64_t null_bytes = CSV_NULL_WORDS(table->row_count) * sizeof(uint64_t);
+    uint64_t offset = sizeof(header) + table->column_count * sizeof(CSVCacheColumn);
+    for (size_t j = 0; j < table->column_count; j++) {
+        const CSVColumn *col = &table->columns[j];
+        CSVCacheColumn *desc = &descs[j];
+        
+        desc->type = col->type;
+        desc->name_length = strlen(col->name);
+        desc->name_offset = offset;
+        offset += CSV_CACHE_ALIGN(desc->name_length + 1);
+        desc->nulls_offset = offset;
+        offset += null_bytes;
+        if (col->type == CSV_TYPE_STRING) {
+            desc->offsets_offset = offset;
+            offset += (table->row_count + 1) * sizeof(uint64_t);
+        }
+        desc->data_size = csv_cache_data_size(col, table->row_count);
+        desc->data_offset = offset;
+        offset += CSV_CACHE_ALIGN(desc->data_size);
+    }
+    header.file_size = offset;
+    
+    char tmp_path[4096];
+    int n = snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", cache_path, (long)getpid());
+    if (n < 0 || (size_t)n >= sizeof(tmp_path)) {
+        fprintf(stderr, "Cache path too long: %s\n", cache_path);
+        free(descs);
+        return false;
+    }
+    
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) {
+        fprintf(stderr, "Error opening file: %s\n", tmp_path);
+        free(descs);
+        return false;
+    }
+    
+    bool ok = csv_cache_put(file, &header, sizeof(header)) &&
+              csv_cache_put(file, descs, table->column_count * sizeof(CSVCacheColumn));
+    for (size_t j = 0; ok && j < table->column_count; j++) {
+        const CSVColumn *col = &table->columns[j];
+        
+        ok = csv_cache_put(file, col->name, descs[j].name_length + 1) &&
+             csv_cache_put(file, col->nulls, null_bytes);
+        if (ok && col->type == CSV_TYPE_STRING) {
+            ok = csv_cache_put(file, col->offsets, (table->row_count + 1) * sizeof(uint64_t)) &&
+                 csv_cache_put(file, col->arena, col->arena_size);
+        } else if (ok) {
+            ok = csv_cache_put(file, col->values.ints, descs[j].data_size);
+        }
+    }
+    free(descs);
+    
+    if (fclose(file) != 0) ok = false;
+    if (ok && rename(tmp_path, cache_path) != 0) ok = false;
+    if (!ok) {
+        fprintf(stderr, "Error writing file: %s\n", cache_path);
+        unlink(tmp_path);
+    }
+    return ok;
+}
+
+// Is [offset, offset + size) an aligned range inside the mapping?
+static bool csv_cache_range_ok(uint64_t offset, uint64_t size, uint64_t file_size) {
+    return offset % 8 == 0 && offset <= file_size && size <= file_size - offset;
+}
+
+// Load a cache saved by csv_columnar_save. Returns NULL (quietly) if there
+// is no cache or it is stale, i.e. source_path or the dialect changed since
+// it was written. The columns point straight into a read-only mapping of
+// the cache and must not be modified.
+CSVColumnarTable* csv_columnar_load(const char *cache_path, const char *source_path,
+                                    char delimiter, char quote_char) {
+    int fd = open(cache_path, O_RDONLY);
+    if (fd < 0) return NULL;
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(CSVCacheHeader)) {
+        close(fd);
+        return NULL;
+    }
+    void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return NULL;
+    
+    const char *base = (const char*)mapping;
+    const CSVCacheHeader *header = (const CSVCacheHeader*)mapping;
+    CSVCacheHeader key = {0};
+    uint64_t file_size = st.st_size;
+    CSVColumnarTable *table = NULL;
+    
+    if (memcmp(header->magic, CSV_CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != CSV_CACHE_VERSION ||
+        header->byte_order != CSV_CACHE_BYTE_ORDER ||
+        header->file_size != file_size ||
+        header->delimiter != delimiter || header->quote_char != quote_char ||
+        !csv_cache_key(source_path, &key) ||
+        header->source_size != key.source_size ||
+        header->source_mtime_sec != key.source_mtime_sec ||
+        header->source_mtime_nsec != key.source_mtime_nsec ||
+        header->column_count > (file_size - sizeof(*header)) / sizeof(CSVCacheColumn)) {
+        goto fail;
+    }
+    
+    table = (CSVColumnarTable*)calloc(1, sizeof(CSVColumnarTable));
+    if (!table) goto fail;
+    table->mapping = mapping;
+    table->mapping_size = file_size;
+    table->row_count = header->row_count;
+    table->column_count = header->column_count;
+    table->columns = (CSVColumn*)calloc(table->column_count ? table->column_count : 1,
+                                        sizeof(CSVColumn));
+    if (!table->columns) goto fail;
+    
+    // Every array is bounds-checked, and a string column's offsets must
+    // climb from 0 to the arena size so that every value lies inside it
+    const CSVCacheColumn *descs = (const CSVCacheColumn*)(base + sizeof(*header));
+    uint64_t rows = table->row_count;
+    if (rows >= file_size) goto fail;
+    uint64_t null_bytes = CSV_NULL_WORDS(rows) * sizeof(uint64_t);
+    
+    for (size_t j = 0; j < table->column_count; j++) {
+        const CSVCacheColumn *desc = &descs[j];
+        CSVColumn *col = &table->columns[j];
+        
+        if (desc->type > CSV_TYPE_BOOL || desc->name_length >= file_size ||
+            !csv_cache_range_ok(desc->name_offset, desc->name_length + 1, file_size) ||
+            base[desc->name_offset + desc->name_length] != '\0' ||
+            !csv_cache_range_ok(desc->nulls_offset, null_bytes, file_size) ||
+            !csv_cache_range_ok(desc->data_offset, desc->data_size, file_size)) {
+            goto fail;
+        }
+        
+        col->name = (char*)base + desc->name_offset;
+        col->type = (CSVColumnType)desc->type;
+        col->nulls = (uint64_t*)(base + desc->nulls_offset);
+        
+        if (col->type == CSV_TYPE_STRING) {
+            if (!csv_cache_range_ok(desc->offsets_offset, (rows + 1) * sizeof(uint64_t),
+                                    file_size)) {
+                goto fail;
+            }
+            col->offsets = (uint64_t*)(base + desc->offsets_offset);
+            if (col->offsets[0] != 0 || col->offsets[rows] != desc->data_size) goto fail;
+            for (uint64_t i = 0; i < rows; i++) {
+                if (col->offsets[i] > col->offsets[i + 1]) goto fail;
+            }
+            col->arena = desc->data_size ? (char*)base + desc->data_offset : NULL;
+            col->arena_size = desc->data_size;
+        } else {
+            CSVColumn probe = {0};
+            probe.type = col->type;
+            if (desc->data_size != csv_cache_data_size(&probe, rows)) goto fail;
+            col->values.ints = (int64_t*)(base + desc->data_offset);
+        }
+    }
+    
+    if (!csv_header_index_init(&table->index, table->column_count)) goto fail;
+    for (size_t j = 0; j < table->column_count; j++) {
+        csv_header_index_add(&table->index, table->columns[j].name, j);
+    }
+    return table;
+    
+fail:
+    if (table) {
+        csv_columnar_free(table); // Unmaps
+    } else {
+        munmap(mapping, file_size);
+    }
+    return NULL;
+}
+
+// Load filename's columnar form from cache_path if the cache is current,
+// otherwise parse it and (re)write the cache. A NULL cache_path uses
+// "<filename>.cache".
+CSVColumnarTable* csv_parse_columnar_cached(const char *filename, char delimiter,
+                                            char quote_char, const char *cache_path) {
+    char default_path[4096];
+    if (!cache_path) {
+        int n = snprintf(default_path, sizeof(default_path), "%s.cache", filename);
+        if (n < 0 || (size_t)n >= sizeof(default_path)) {
+            return csv_parse_columnar(filename, delimiter, quote_char);
+        }
+        cache_path = default_path;
+    }
+    
+    CSVColumnarTable *table = csv_columnar_load(cache_path, filename, delimiter, quote_char);
+    if (table) return table;
+    
+    table = csv_parse_columnar(filename, delimiter, quote_char);
+    if (table) {
+        csv_columnar_save(table, cache_path, filename, delimiter, quote_char); // Best effort
+    }
+    return table;
+}
+
+// Streaming demo callback: sum the Age column (the header doesn't parse)
+static bool sum_ages(const CSVRow *row, void *user_data) {
+    long *total = (long*)user_data;
+    int64_t age;
+    if (row->field_count > 1 &&
+        csv_parse_int64(row->fields[1].data, row->fields[1].length, &age)) {
+        *total += (long)age;
+    }
+    return true;
+}
+
+// Read-options demo predicate: keep rows whose first projected column (the
+// salary) is at least *user_data
+static bool salary_at_least(const CSVRow *row, void *user_data) {
+    long minimum = *(const long*)user_data;
+    int64_t salary;
+    return row->field_count > 0 &&
+           csv_parse_int64(row->fields[0].data, row->fields[0].length, &salary) &&
+           salary >= minimum;
+}
+
+// Follow-mode demo: poll once and show what arrived
+static void follow_demo_poll(CSVReader *reader, CSVData *csv, const char *label) {
+    long appended = csv_follow_poll(reader, csv);
+    const char *last = csv->row_count > 0 ?
+        csv_get_field(csv, csv->row_count - 1, 1) : NULL;
+    printf("%s: %ld new rows, last event [%s]\n", label, appended, last ? last : "");
+}
+
+// Demo function
+void csv_parser_demo() {
+    printf("=== CSV Parser Demo ===\n\n");
+    
+    // Create sample CSV data
+    const char *csv_string = 
+        "Name,Age,City,Salary\n"
         "John Doe,30,\"New York\",50000\n"
         "Jane Smith,25,\"Los Angeles\",60000\n"
         "Bob Johnson,35,Chicago,55000\n"
@@ -456,12 +3021,154 @@ void csv_parser_demo() {
                        csv_get_field_by_name(table, i, "Salary"));
             }
             
+            // Resolve once, then index directly in the loop
+            CSVColumnHandle city = csv_table_column(table, "City");
+            printf("\nCities:");
+            for (size_t i = 0; i < table->data->row_count; i++) {
+                printf(" [%s]", csv_get_field_by_handle(table, i, city));
+            }
+            printf("\n");
+            
             csv_table_free(table);
         }
+        
+        // Columnar layout: the Salary column is a packed int64 array
+        CSVColumnarTable *columns = csv_parse_columnar("test_with_headers.csv", ',', '"');
+        if (columns) {
+            const CSVColumn *salary = csv_columnar_find(columns, "Salary");
+            if (salary && salary->type == CSV_TYPE_INT64) {
+                int64_t total = 0;
+                for (size_t i = 0; i < columns->row_count; i++) {
+                    total += salary->values.ints[i];
+                }
+                printf("\nColumnar Salary total: %lld\n", (long long)total);
+            }
+            csv_columnar_free(columns);
+        }
+        
+        // The second call maps the cache written by the first
+        for (int pass = 0; pass < 2; pass++) {
+            CSVColumnarTable *cached = csv_parse_columnar_cached("test_with_headers.csv",
+                                                                 ',', '"', NULL);
+            if (cached) {
+                printf("Columnar %s: %zu rows\n", cached->mapping ? "cache" : "parse",
+                       cached->row_count);
+                csv_columnar_free(cached);
+            }
+        }
+        
+        // Zero-copy parse of the same file
+        printf("\n=== Memory-Mapped CSV Demo ===\n");
+        CSVData *mapped = csv_parse_file_mmap("test_with_headers.csv", ',', '"');
+        if (mapped) {
+            csv_print(mapped);
+            
+            size_t length = 0;
+            const char *city = csv_get_field_view(mapped, 4, 2, &length);
+            printf("Row 4, Col 2: %.*s\n", (int)length, city);
+            
+            csv_free(mapped);
+        }
+        
+        // Same file split across all CPUs (small files use a single chunk)
+        CSVData *parallel = csv_parse_file_parallel("test_with_headers.csv", ',', '"', 0);
+        if (parallel) {
+            printf("Parallel parse: %zu rows\n", parallel->row_count);
+            csv_free(parallel);
+        }
+        
+        // Stream it row by row in constant memory
+        long total_age = 0;
+        if (csv_foreach_row("test_with_headers.csv", ',', '"', sum_ages, &total_age)) {
+            printf("Streamed total age: %ld\n", total_age);
+        }
+        
+        // A quote inside an unquoted field is just a character
+        CSVData *heights = csv_parse_string("John,5'11\",180\nJane,5'4\",125\n", ',', '"');
+        if (heights) {
+            printf("\nHeights: [%s] [%s], [%s] [%s]\n",
+                   csv_get_field(heights, 0, 1), csv_get_field(heights, 0, 2),
+                   csv_get_field(heights, 1, 1), csv_get_field(heights, 1, 2));
+            csv_free(heights);
+        }
+        
+        // Read only two columns, and only the rows that pass the filter
+        printf("\n=== Projection and Filter Demo ===\n");
+        const char *wanted[] = {"Salary", "Name"};
+        long minimum = 58000;
+        CSVReadOptions options = {0};
+        options.column_names = wanted;
+        options.column_count = 2;
+        options.has_header = true;
+        options.predicate = salary_at_least;
+        options.user_data = &minimum;
+        
+        CSVData *selected = csv_parse_file_ex("test_with_headers.csv", ',', '"', &options);
+        if (selected) {
+            csv_print(selected);
+            csv_free(selected);
+        }
+        
+        // Follow a growing file: a partial last line waits for the rest of
+        // it, and truncation or replacement starts over
+        printf("\n=== Follow Mode Demo ===\n");
+        FILE *log = fopen("test_follow.csv", "w");
+        CSVReader *follower = log ? csv_follow_open("test_follow.csv", ',', '"', 0) : NULL;
+        CSVData *followed = csv_init(',', '"');
+        if (follower && followed) {
+            fputs("id,event\n1,start\n2,ru", log);
+            fflush(log);
+            follow_demo_poll(follower, followed, "Appended 2 lines and a partial one");
+            
+            fputs("nning\n", log);
+            fflush(log);
+            follow_demo_poll(follower, followed, "Completed the line");
+            
+            log = freopen("test_follow.csv", "w", log);     // Truncate in place
+            if (log) {
+                fputs("1,restart\n", log);
+                fflush(log);
+                follow_demo_poll(follower, followed, "Truncated and rewritten");
+            }
+            
+            if (log && rename("test_follow.csv", "test_follow.csv.1") == 0) {
+                fputs("2,rotating\n", log);                // Still the old file
+                fclose(log);
+                log = fopen("test_follow.csv", "w");
+                if (log) {
+                    fputs("1,rotated\n", log);
+                    fflush(log);
+                    follow_demo_poll(follower, followed, "Rotated");
+                }
+                remove("test_follow.csv.1");
+            }
+        }
+        if (log) fclose(log);
+        csv_reader_close(follower);
+        csv_free(followed);
+        
+#ifdef CSV_WITH_ZLIB
+        // Compressed input is decompressed on a second thread while parsing
+        gzFile gz = gzopen("test_with_headers.csv.gz", "wb");
+        if (gz) {
+            gzputs(gz, csv_string);
+            gzclose(gz);
+            
+            CSVData *unzipped = csv_parse_file("test_with_headers.csv.gz", ',', '"');
+            if (unzipped) {
+                printf("\nParsed %zu rows from test_with_headers.csv.gz\n",
+                       unzipped->row_count);
+                csv_free(unzipped);
+            }
+        }
+#endif
     }
 }
 
+// csv_benchmark.c includes this file and brings its own main
+#ifndef CSV_PARSER_NO_MAIN
 int main() {
     csv_parser_demo();
     return 0;
-}
\ No newline at end of file
+}
+#endif
@@ -1,21 +1,135 @@
+#define _POSIX_C_SOURCE 200809L   // localtime_r, clock_gettime under -std=c11
+
 #include "logger.h"
+#include <ctype.h>
 #include <errno.h>
+#include <stdatomic.h>
 #include <sys/stat.h>
 
+#ifdef PLATFORM_UNIX
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/uio.h>
+#endif
+
 // Global logger instance
 Logger *g_logger = NULL;
 
-// Log level names
-static const char *log_level_names[LOG_LEVEL_COUNT] = {
-    "TRACE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL"
+// Level tags as they appear in a line, plain and colored. Lines are
+// formatted with the plain tag; the console sink swaps in the colored one.
+#define LOGGER_TAG_LENGTH 8
+
+static const char *log_level_tags[LOG_LEVEL_COUNT] = {
+    "[TRACE] ", "[DEBUG] ", "[INFO ] ", "[WARN ] ", "[ERROR] ", "[FATAL] "
 };
 
-// Log level colors
-static const char *log_level_colors[LOG_LEVEL_COUNT] = {
-    COLOR_TRACE, COLOR_DEBUG, COLOR_INFO, 
-    COLOR_WARN, COLOR_ERROR, COLOR_FATAL
+static const char *log_level_color_tags[LOG_LEVEL_COUNT] = {
+    COLOR_TRACE "[TRACE]" COLOR_RESET " ", COLOR_DEBUG "[DEBUG]" COLOR_RESET " ",
+    COLOR_INFO "[INFO ]" COLOR_RESET " ", COLOR_WARN "[WARN ]" COLOR_RESET " ",
+    COLOR_ERROR "[ERROR]" COLOR_RESET " ", COLOR_FATAL "[FATAL]" COLOR_RESET " "
 };
 
+// Thread-local storage class
+#if defined(_MSC_VER)
+    #define LOGGER_THREAD_LOCAL __declspec(thread)
+#else
+    #define LOGGER_THREAD_LOCAL _Thread_local
+#endif
+
+#define LOGGER_LINE_MAX 2048
+
+// Per-thread formatting state: the line buffer, and the timestamp text for
+// the current second so it is only rebuilt when the second changes
+typedef struct {
+    int64_t second;             // Second the cached text is for
+    char timestamp[32];         // "[YYYY-mm-dd HH:MM:SS"
+    size_t timestamp_length;
+    char line[LOGGER_LINE_MAX];
+} LogThreadBuffer;
+
+static LOGGER_THREAD_LOCAL LogThreadBuffer tls_buffer = { .second = INT64_MIN };
+
+// Nanoseconds on a clock that never goes backwards. On Unix that is the
+// monotonic clock; logger_create records its offset from the wall clock.
+static int64_t clock_now_ns(void) {
+    struct timespec ts;
+#ifdef PLATFORM_WINDOWS
+    timespec_get(&ts, TIME_UTC);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int64_t clock_wall_offset_ns(void) {
+#ifdef PLATFORM_WINDOWS
+    return 0;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec - clock_now_ns();
+#endif
+}
+
+// Current wall-clock time in nanoseconds
+static int64_t logger_now_ns(const Logger *logger) {
+    return clock_now_ns() + logger->clock_offset_ns;
+}
+
+// Append "[YYYY-mm-dd HH:MM:SS] " (or "...SS.uuuuuu] ") for wall-clock time
+// now to out
+static size_t format_timestamp(const Logger *logger, int64_t now, char *out) {
+    int64_t second = now / 1000000000;
+    LogThreadBuffer *tls = &tls_buffer;
+    
+    // localtime/strftime run once per second per thread
+    if (second != tls->second) {
+        time_t raw_time = (time_t)second;
+        struct tm time_info;
+#ifdef PLATFORM_WINDOWS
+        localtime_s(&time_info, &raw_time);
+#else
+        localtime_r(&raw_time, &time_info);
+#endif
+        tls->timestamp[0] = '[';
+        tls->timestamp_length = 1 + strftime(tls->timestamp + 1, sizeof(tls->timestamp) - 1,
+                                             "%Y-%m-%d %H:%M:%S", &time_info);
+        tls->second = second;
+    }
+    
+    size_t n = tls->timestamp_length;
+    memcpy(out, tls->timestamp, n);
+    
+    if (logger->config.precise_timestamp) {
+        unsigned micros = (unsigned)(now % 1000000000 / 1000);
+        out[n++] = '.';
+        for (int i = 5; i >= 0; i--) {
+            out[n + i] = (char)('0' + micros % 10);
+            micros /= 10;
+        }
+        n += 6;
+    }
+    
+    out[n++] = ']';
+    out[n++] = ' ';
+    return n;
+}
+
+// Append the decimal digits of a non-negative value
+static size_t format_uint(char *out, unsigned value) {
+    char digits[16];
+    size_t count = 0;
+    do {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    
+    for (size_t i = 0; i < count; i++) {
+        out[i] = digits[count - 1 - i];
+    }
+    return count;
+}
+
 // Initialize mutex based on platform
 static void mutex_init(Logger *logger) {
 #ifdef PLATFORM_WINDOWS
@@ -25,13 +139,19 @@ static void mutex_init(Logger *logger) {
 #endif
 }
 
-// Lock mutex
+// Lock mutex; only a contended lock reads the clock, to account the wait
 static void mutex_lock(Logger *logger) {
 #ifdef PLATFORM_WINDOWS
+    if (TryEnterCriticalSection(&logger->mutex)) return;
+    int64_t start = clock_now_ns();
     EnterCriticalSection(&logger->mutex);
 #else
+    if (pthread_mutex_trylock(&logger->mutex) == 0) return;
+    int64_t start = clock_now_ns();
     pthread_mutex_lock(&logger->mutex);
 #endif
+    logger->mutex_waits++;
+    logger->mutex_wait_ns += (uint64_t)(clock_now_ns() - start);
 }
 
 // Unlock mutex
@@ -56,12 +176,596 @@ static void mutex_destroy(Logger *logger) {
 static size_t get_file_size(FILE *file) {
     if (!file) return 0;
     
-    long current_pos = ftell(file);
-    fseek(file, 0, SEEK_END);
-    size_t size = ftell(file);
-    fseek(file, current_pos, SEEK_SET);
+    struct stat st;
+    if (fstat(fileno(file), &st) != 0) return 0;
     
-    return size;
+    return (size_t)st.st_size;
+}
+
+// Memory-mapped file sink
+//
+// With LogConfig.mmap_file set, the log file grows LOGGER_MAP_WINDOW bytes
+// at a time with posix_fallocate and the current window is mapped, so
+// appending a line is a memcpy rather than a write system call. The kernel
+// writes the pages back on its own; msync(MS_ASYNC) is requested every
+// LOGGER_MSYNC_BYTES and by logger_flush. Closing the file (rotation,
+// logger_destroy) trims the preallocated tail, so after a crash the file
+// can end in zero bytes. Only one process may append to the file.
+#define LOGGER_MAP_WINDOW (4 * 1024 * 1024)   // Multiple of the page size
+#define LOGGER_MSYNC_BYTES (1024 * 1024)
+
+#ifdef PLATFORM_UNIX
+struct LogSegment {
+    int fd;
+    char *map;              // Current window, NULL if mapping failed
+    size_t map_offset;      // File offset of the window
+    size_t length;          // Bytes of log in the file
+    size_t synced;          // length at the last msync
+};
+
+// Map the window that length falls in, preallocating it first
+static bool segment_map(LogSegment *segment) {
+    if (segment->map) munmap(segment->map, LOGGER_MAP_WINDOW);
+    segment->map = NULL;
+    
+    size_t offset = segment->length & ~(size_t)(LOGGER_MAP_WINDOW - 1);
+    if (posix_fallocate(segment->fd, (off_t)offset, LOGGER_MAP_WINDOW) != 0) return false;
+    
+    void *map = mmap(NULL, LOGGER_MAP_WINDOW, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     segment->fd, (off_t)offset);
+    if (map == MAP_FAILED) return false;
+    
+    segment->map = (char*)map;
+    segment->map_offset = offset;
+    segment->synced = segment->length;
+    return true;
+}
+
+// Open path for appending (or truncate it); NULL on failure
+static LogSegment* segment_open(const char *path, bool truncate) {
+    int fd = open(path, O_RDWR | O_CREAT | (truncate ? O_TRUNC : 0), 0644);
+    if (fd < 0) return NULL;
+    
+    struct stat st;
+    LogSegment *segment = (LogSegment*)calloc(1, sizeof(LogSegment));
+    if (!segment || fstat(fd, &st) != 0) {
+        free(segment);
+        close(fd);
+        return NULL;
+    }
+    
+    segment->fd = fd;
+    segment->length = (size_t)st.st_size;
+    if (!segment_map(segment)) {
+        close(fd);
+        free(segment);
+        return NULL;
+    }
+    
+    return segment;
+}
+
+// Ask the kernel to start writing back what was appended since last time
+static void segment_sync(LogSegment *segment) {
+    if (segment->map && segment->length > segment->synced) {
+        msync(segment->map, LOGGER_MAP_WINDOW, MS_ASYNC);
+        segment->synced = segment->length;
+    }
+}
+
+// Append data; returns how much was written, less than length only if a
+// new window could not be mapped
+static size_t segment_write(LogSegment *segment, const char *data, size_t length) {
+    size_t done = 0;
+    
+    while (done < length) {
+        size_t used = segment->length - segment->map_offset;
+        if (used == LOGGER_MAP_WINDOW) {
+            if (!segment_map(segment)) break;
+            used = segment->length - segment->map_offset;
+        }
+        
+        size_t chunk = length - done;
+        if (chunk > LOGGER_MAP_WINDOW - used) chunk = LOGGER_MAP_WINDOW - used;
+        memcpy(segment->map + used, data + done, chunk);
+        segment->length += chunk;
+        done += chunk;
+    }
+    
+    if (segment->length - segment->synced >= LOGGER_MSYNC_BYTES) segment_sync(segment);
+    return done;
+}
+
+// Unmap, trim the preallocated tail and close
+static void segment_close(LogSegment *segment) {
+    if (segment->map) munmap(segment->map, LOGGER_MAP_WINDOW);
+    if (ftruncate(segment->fd, (off_t)segment->length) != 0) {
+        fprintf(stderr, "Failed to trim log file: %s\n", strerror(errno));
+    }
+    close(segment->fd);
+    free(segment);
+}
+#else
+// No mapped writer on Windows; the file is written through stdio
+static LogSegment* segment_open(const char *path, bool truncate) {
+    (void)path;
+    (void)truncate;
+    return NULL;
+}
+
+static void segment_sync(LogSegment *segment) { (void)segment; }
+static size_t segment_write(LogSegment *segment, const char *data, size_t length) {
+    (void)segment;
+    (void)data;
+    (void)length;
+    return 0;
+}
+static void segment_close(LogSegment *segment) { (void)segment; }
+#endif
+
+// Close a log file, whichever way it is open
+static void close_log_file(FILE *file, LogSegment *segment) {
+    if (segment) {
+        segment_close(segment);
+    } else if (file) {
+        fclose(file);
+    }
+}
+
+// Create (or truncate) path as a log file
+static void open_log_file(const Logger *logger, const char *path,
+                          FILE **file, LogSegment **segment) {
+    *segment = logger->config.mmap_file ? segment_open(path, true) : NULL;
+    *file = *segment ? NULL : fopen(path, "w");
+}
+
+// Part of a line handed to a sink
+typedef struct {
+    const char *data;
+    size_t length;
+} LogSlice;
+
+#ifdef PLATFORM_UNIX
+// writev all of iov, resuming after partial writes
+static void write_all(int fd, struct iovec *iov, int count) {
+    while (count > 0) {
+        ssize_t n = writev(fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= (ssize_t)iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char*)iov->iov_base + n;
+            iov->iov_len -= (size_t)n;
+        }
+    }
+}
+#endif
+
+// Write slices to a stdio stream. A flushed write (every line, unless
+// async) goes to the descriptor in one writev, after whatever the stream
+// already buffers; otherwise the slices collect in the stream's buffer
+// until the writer thread flushes the batch.
+static void sink_write(FILE *output, const LogSlice *slices, int count, bool flush) {
+#ifdef PLATFORM_UNIX
+    if (flush) {
+        struct iovec iov[4];
+        fflush(output);
+        for (int i = 0; i < count; i++) {
+            iov[i].iov_base = (void*)slices[i].data;
+            iov[i].iov_len = slices[i].length;
+        }
+        write_all(fileno(output), iov, count);
+        return;
+    }
+#endif
+    for (int i = 0; i < count; i++) {
+        fwrite(slices[i].data, 1, slices[i].length, output);
+    }
+    if (flush) fflush(output);
+}
+
+// Append to the log file, whichever way it is open
+static void file_write(Logger *logger, const char *data, size_t length, bool flush) {
+    size_t done = 0;
+    
+    if (logger->segment) {
+        done = segment_write(logger->segment, data, length);
+        if (done < length) {
+            // Out of space or address space: carry on through stdio
+            fprintf(stderr, "Failed to map log file, falling back to stdio: %s\n",
+                    strerror(errno));
+            segment_close(logger->segment);
+            logger->segment = NULL;
+            logger->file = fopen(logger->config.log_file_path, "a");
+        }
+    }
+    if (done < length && logger->file) {
+        LogSlice slice = { data + done, length - done };
+        sink_write(logger->file, &slice, 1, flush);
+    }
+    
+    logger->current_file_size += length;
+}
+
+// Async mode
+//
+// Callers format their line and push it onto a lock-free multi-producer,
+// single-consumer queue (Vyukov's intrusive MPSC list), then return. A
+// writer thread pops the lines and writes them in batches, flushing each
+// sink once per batch instead of once per line. Producers only touch a
+// lock to wake the writer when it is idle.
+#define LOGGER_ASYNC_BATCH 256      // Lines written per flush
+#define LOGGER_ASYNC_IDLE_MS 10     // Writer re-checks the queue this often
+
+typedef struct LogRing LogRing;     // Binary mode record ring (see below)
+
+typedef struct LogRecord {
+    _Atomic(struct LogRecord*) next;
+    LogLevel level;
+    size_t length;
+    size_t tag_offset;
+    char text[];
+} LogRecord;
+
+struct LogAsync {
+    _Atomic(LogRecord*) head;       // Last pushed record; producers swap in here
+    LogRecord *tail;                // Next record to pop (writer only)
+    LogRecord *stub;                // Keeps the list non-empty
+    atomic_bool sleeping;           // Writer is (about to be) waiting for work
+    atomic_bool stop;
+    atomic_size_t pushed;
+    atomic_size_t written;
+    LogRing *ring;                  // Binary mode only
+#ifdef PLATFORM_WINDOWS
+    HANDLE thread;
+    CRITICAL_SECTION wake_lock;
+    CONDITION_VARIABLE wake;        // Signalled when records arrive
+    CONDITION_VARIABLE drained;     // Broadcast after every batch
+#else
+    pthread_t thread;
+    pthread_mutex_t wake_lock;
+    pthread_cond_t wake;
+    pthread_cond_t drained;
+#endif
+};
+
+// Condition variable helpers for the writer thread
+static void async_lock(LogAsync *async) {
+#ifdef PLATFORM_WINDOWS
+    EnterCriticalSection(&async->wake_lock);
+#else
+    pthread_mutex_lock(&async->wake_lock);
+#endif
+}
+
+static void async_unlock(LogAsync *async) {
+#ifdef PLATFORM_WINDOWS
+    LeaveCriticalSection(&async->wake_lock);
+#else
+    pthread_mutex_unlock(&async->wake_lock);
+#endif
+}
+
+static void async_signal(LogAsync *async) {
+#ifdef PLATFORM_WINDOWS
+    WakeConditionVariable(&async->wake);
+#else
+    pthread_cond_signal(&async->wake);
+#endif
+}
+
+static void async_broadcast_drained(LogAsync *async) {
+#ifdef PLATFORM_WINDOWS
+    WakeAllConditionVariable(&async->drained);
+#else
+    pthread_cond_broadcast(&async->drained);
+#endif
+}
+
+// Wake the writer thread
+static void async_wake(LogAsync *async) {
+    async_lock(async);
+    async_signal(async);
+    async_unlock(async);
+}
+
+// Wake the writer only if it is idle; cheap enough for every log call
+static void async_wake_if_sleeping(LogAsync *async) {
+    if (atomic_load(&async->sleeping)) async_wake(async);
+}
+
+static void thread_yield(void) {
+#ifdef PLATFORM_WINDOWS
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+// Wait on cond (with wake_lock held) for at most timeout_ms
+static void async_wait(LogAsync *async, bool drained, int timeout_ms) {
+#ifdef PLATFORM_WINDOWS
+    SleepConditionVariableCS(drained ? &async->drained : &async->wake,
+                             &async->wake_lock, timeout_ms);
+#else
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += (long)timeout_ms * 1000000L;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+    pthread_cond_timedwait(drained ? &async->drained : &async->wake,
+                           &async->wake_lock, &deadline);
+#endif
+}
+
+// Producer side: safe from any number of threads
+static void log_queue_push(LogAsync *async, LogRecord *record) {
+    atomic_store_explicit(&record->next, NULL, memory_order_relaxed);
+    LogRecord *prev = atomic_exchange_explicit(&async->head, record, memory_order_acq_rel);
+    atomic_store_explicit(&prev->next, record, memory_order_release);
+}
+
+// Consumer side. Returns NULL when the queue is empty or a producer is
+// between its two steps in log_queue_push (the record shows up shortly).
+static LogRecord* log_queue_pop(LogAsync *async) {
+    LogRecord *tail = async->tail;
+    LogRecord *next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    
+    if (tail == async->stub) {
+        if (!next) return NULL;
+        async->tail = next;
+        tail = next;
+        next = atomic_load_explicit(&next->next, memory_order_acquire);
+    }
+    
+    if (next) {
+        async->tail = next;
+        return tail;
+    }
+    
+    // tail is the last record: put the stub behind it so it can be taken
+    if (tail != atomic_load_explicit(&async->head, memory_order_acquire)) return NULL;
+    log_queue_push(async, async->stub);
+    
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (next) {
+        async->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+static bool log_queue_empty(LogAsync *async) {
+    return async->tail == async->stub &&
+           atomic_load_explicit(&async->stub->next, memory_order_acquire) == NULL &&
+           atomic_load(&async->head) == async->stub;
+}
+
+static void rotate_file_locked(Logger *logger);
+static bool rotator_start(Logger *logger);
+static void rotator_stop(Logger *logger);
+static bool rotator_swap(Logger *logger, bool wait);
+static LogRing* ring_create(void);
+static void ring_destroy(LogRing *ring);
+static size_t ring_drain(Logger *logger, LogRing *ring, size_t max);
+static bool ring_empty(LogRing *ring);
+static void ring_push_text(LogAsync *async, LogLevel level, const char *line,
+                           size_t length, size_t tag_offset);
+static double timer_tick_ns(void);
+static void timer_free_all(void);
+
+// Write one finished line to the console and file sinks; the caller holds
+// the logger mutex. The line carries the plain level tag at tag_offset:
+// the file gets the line as is, the console gets it in three slices with
+// the colored tag in the middle. Sinks are flushed only if flush is set.
+static void write_line(Logger *logger, LogLevel level, const char *line,
+                       size_t length, size_t tag_offset, bool flush) {
+    // Output to console
+    if (logger->config.log_to_console) {
+        FILE *output = (level >= LOG_ERROR) ? stderr : stdout;
+        if (logger->config.use_colors) {
+            const char *tag = log_level_color_tags[level];
+            size_t rest = tag_offset + LOGGER_TAG_LENGTH;
+            LogSlice slices[3] = {
+                { line, tag_offset },
+                { tag, strlen(tag) },
+                { line + rest, length - rest }
+            };
+            sink_write(output, slices, 3, flush);
+        } else {
+            LogSlice slice = { line, length };
+            sink_write(output, &slice, 1, flush);
+        }
+    }
+    
+    // Output to file
+    if (logger->file || logger->segment) {
+        file_write(logger, line, length, flush);
+        
+        // Check if rotation is needed
+        if (logger->config.max_file_size > 0 && 
+            logger->current_file_size >= logger->config.max_file_size) {
+            // In the background if set up, else now
+            if (!logger->rotator) {
+                rotate_file_locked(logger);
+            } else {
+                rotator_swap(logger, false);
+            }
+        }
+    }
+}
+
+// Writer thread: drain the queue in batches until stopped and empty
+#ifdef PLATFORM_WINDOWS
+static DWORD WINAPI async_writer(LPVOID arg) {
+#else
+static void* async_writer(void *arg) {
+#endif
+    Logger *logger = (Logger*)arg;
+    LogAsync *async = logger->async;
+    
+    for (;;) {
+        size_t count = 0;
+        LogRecord *record;
+        
+        mutex_lock(logger);
+        while (count < LOGGER_ASYNC_BATCH && (record = log_queue_pop(async)) != NULL) {
+            write_line(logger, record->level, record->text, record->length,
+                       record->tag_offset, false);
+            free(record);
+            count++;
+        }
+        if (async->ring) {
+            count += ring_drain(logger, async->ring, LOGGER_ASYNC_BATCH);
+        }
+        if (count > 0) {
+            if (logger->config.log_to_console) {
+                fflush(stdout);
+                fflush(stderr);
+            }
+            if (logger->file) fflush(logger->file);
+        }
+        mutex_unlock(logger);
+        
+        async_lock(async);
+        if (count > 0) {
+            atomic_fetch_add(&async->written, count);
+            async_broadcast_drained(async);
+        } else if (atomic_load(&async->stop) && log_queue_empty(async) &&
+                   (!async->ring || ring_empty(async->ring))) {
+            async_unlock(async);
+            break;
+        } else {
+            // Producers seeing sleeping set will signal; the timeout covers
+            // a record caught halfway through log_queue_push
+            atomic_store(&async->sleeping, true);
+            if (log_queue_empty(async) && (!async->ring || ring_empty(async->ring)) &&
+                !atomic_load(&async->stop)) {
+                async_wait(async, false, LOGGER_ASYNC_IDLE_MS);
+            }
+            atomic_store(&async->sleeping, false);
+        }
+        async_unlock(async);
+    }
+
+#ifdef PLATFORM_WINDOWS
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+// Start the writer thread
+static bool async_start(Logger *logger) {
+    LogAsync *async = (LogAsync*)calloc(1, sizeof(LogAsync));
+    if (!async) return false;
+    
+    async->stub = (LogRecord*)calloc(1, sizeof(LogRecord));
+    if (!async->stub) {
+        free(async);
+        return false;
+    }
+    atomic_init(&async->head, async->stub);
+    async->tail = async->stub;
+    if (logger->config.binary && !(async->ring = ring_create())) {
+        free(async->stub);
+        free(async);
+        return false;
+    }
+    logger->async = async;
+
+#ifdef PLATFORM_WINDOWS
+    InitializeCriticalSection(&async->wake_lock);
+    InitializeConditionVariable(&async->wake);
+    InitializeConditionVariable(&async->drained);
+    async->thread = CreateThread(NULL, 0, async_writer, logger, 0, NULL);
+    bool started = async->thread != NULL;
+#else
+    pthread_mutex_init(&async->wake_lock, NULL);
+    pthread_cond_init(&async->wake, NULL);
+    pthread_cond_init(&async->drained, NULL);
+    bool started = pthread_create(&async->thread, NULL, async_writer, logger) == 0;
+#endif
+    
+    if (!started) {
+        logger->async = NULL;
+        ring_destroy(async->ring);
+        free(async->stub);
+        free(async);
+    }
+    return started;
+}
+
+// Write out everything queued, then stop the writer thread
+static void async_stop(Logger *logger) {
+    LogAsync *async = logger->async;
+    
+    async_lock(async);
+    atomic_store(&async->stop, true);
+    async_signal(async);
+    async_unlock(async);
+
+#ifdef PLATFORM_WINDOWS
+    WaitForSingleObject(async->thread, INFINITE);
+    CloseHandle(async->thread);
+    DeleteCriticalSection(&async->wake_lock);
+#else
+    pthread_join(async->thread, NULL);
+    pthread_mutex_destroy(&async->wake_lock);
+    pthread_cond_destroy(&async->wake);
+    pthread_cond_destroy(&async->drained);
+#endif
+    
+    ring_destroy(async->ring);
+    free(async->stub);
+    free(async);
+    logger->async = NULL;
+}
+
+// Queue a finished line for the writer thread
+static void async_push(LogAsync *async, LogLevel level, const char *line,
+                       size_t length, size_t tag_offset) {
+    LogRecord *record = (LogRecord*)malloc(sizeof(LogRecord) + length);
+    if (!record) return;
+    
+    record->level = level;
+    record->length = length;
+    record->tag_offset = tag_offset;
+    memcpy(record->text, line, length);
+    
+    atomic_fetch_add(&async->pushed, 1);
+    log_queue_push(async, record);
+    async_wake_if_sleeping(async);
+}
+
+// Block until every line logged so far has been written (async), and
+// start writeback of a mapped log file
+void logger_flush(Logger *logger) {
+    if (!logger) return;
+    
+    LogAsync *async = logger->async;
+    if (async) {
+        size_t target = atomic_load(&async->pushed);
+        
+        async_lock(async);
+        while (atomic_load(&async->written) < target) {
+            async_signal(async);
+            async_wait(async, true, LOGGER_ASYNC_IDLE_MS);
+        }
+        async_unlock(async);
+    }
+    
+    if (logger->segment) {
+        mutex_lock(logger);
+        if (logger->segment) segment_sync(logger->segment);
+        mutex_unlock(logger);
+    }
 }
 
 // Create logger
@@ -74,22 +778,53 @@ Logger* logger_create(const LogConfig *config) {
     
     // Copy configuration
     logger->config = *config;
+    logger->clock_offset_ns = clock_wall_offset_ns();
     
     // Initialize mutex
     mutex_init(logger);
     
     // Open log file if needed
     if (logger->config.log_to_file && strlen(logger->config.log_file_path) > 0) {
-        logger->file = fopen(logger->config.log_file_path, "a");
-        if (!logger->file) {
+        if (logger->config.mmap_file) {
+            logger->segment = segment_open(logger->config.log_file_path, false);
+        }
+        if (logger->segment) {
+            logger->current_file_size = logger->segment->length;
+        } else if (!(logger->file = fopen(logger->config.log_file_path, "a"))) {
             fprintf(stderr, "Failed to open log file: %s\n", 
                     logger->config.log_file_path);
+            mutex_destroy(logger);
             free(logger);
             return NULL;
+        } else {
+            logger->current_file_size = get_file_size(logger->file);
         }
-        logger->current_file_size = get_file_size(logger->file);
     }
     
+    // Start the rotation thread
+    if (logger->config.background_rotation && logger->config.max_file_size > 0 &&
+        (logger->file || logger->segment) && !rotator_start(logger)) {
+        fprintf(stderr, "Failed to start log rotation thread\n");
+        close_log_file(logger->file, logger->segment);
+        mutex_destroy(logger);
+        free(logger);
+        return NULL;
+    }
+    
+    // Start the writer thread
+    if ((logger->config.async || logger->config.binary) && !async_start(logger)) {
+        fprintf(stderr, "Failed to start log writer thread\n");
+        if (logger->rotator) rotator_stop(logger);
+        if (logger->file) fclose(logger->file);
+        if (logger->segment) segment_close(logger->segment);
+        mutex_destroy(logger);
+        free(logger);
+        return NULL;
+    }
+    
+    // Measure the timer clock now, not inside the first LOG_TIMER_END
+    timer_tick_ns();
+    
     return logger;
 }
 
@@ -97,16 +832,25 @@ Logger* logger_create(const LogConfig *config) {
 void logger_destroy(Logger *logger) {
     if (!logger) return;
     
+    // Drain the queue first; the writer needs the file
+    if (logger->async) async_stop(logger);
+    if (logger->rotator) rotator_stop(logger);
+    
     mutex_lock(logger);
     
     if (logger->file) {
         fclose(logger->file);
         logger->file = NULL;
     }
+    if (logger->segment) {
+        segment_close(logger->segment);
+        logger->segment = NULL;
+    }
     
     mutex_unlock(logger);
     mutex_destroy(logger);
     
+    timer_free_all();
     free(logger);
 }
 
@@ -121,22 +865,20 @@ void logger_init_default(void) {
         .include_file_info = true,
         .log_file_path = "",
         .max_file_size = 10 * 1024 * 1024,  // 10MB
-        .max_backup_files = 5
+        .max_backup_files = 5,
+        .async = false,
+        .precise_timestamp = false,
+        .binary = false,
+        .mmap_file = false,
+        .background_rotation = false,
+        .timer_report_ms = 0
     };
     
     g_logger = logger_create(&config);
 }
 
-// Rotate log file
-void logger_rotate_file(Logger *logger) {
-    if (!logger || !logger->file) return;
-    
-    mutex_lock(logger);
-    
-    // Close current file
-    fclose(logger->file);
-    
-    // Rotate backup files
+// Rotate backup files: the log file becomes ".1", ".1" becomes ".2", ...
+static void shift_backups(const Logger *logger) {
     for (int i = logger->config.max_backup_files - 1; i > 0; i--) {
         char old_name[512], new_name[512];
         
@@ -153,124 +895,1111 @@ void logger_rotate_file(Logger *logger) {
         
         rename(old_name, new_name);
     }
-    
-    // Open new file
-    logger->file = fopen(logger->config.log_file_path, "w");
+}
+
+// Rotate log file; the caller holds the mutex
+static void rotate_file_locked(Logger *logger) {
+    close_log_file(logger->file, logger->segment);
+    shift_backups(logger);
+    open_log_file(logger, logger->config.log_file_path, &logger->file, &logger->segment);
     logger->current_file_size = 0;
-    
-    mutex_unlock(logger);
 }
 
-// Main logging function
-void logger_log(Logger *logger, LogLevel level, const char *file, 
-                int line, const char *format, ...) {
-    if (!logger || level < logger->config.min_level) return;
-    
-    mutex_lock(logger);
-    
-    // Get current time
-    time_t raw_time = time(NULL);
-    struct tm *time_info = localtime(&raw_time);
-    char time_str[32];
-    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", time_info);
-    
-    // Extract filename from path
-    const char *filename = file;
-    const char *last_sep = strrchr(file, '/');
-    if (!last_sep) last_sep = strrchr(file, '\\');
-    if (last_sep) filename = last_sep + 1;
+// Background rotation
+//
+// With LogConfig.background_rotation set (Unix), a helper thread keeps the
+// next log file open as "<path>.next". When the current file is full the
+// logging thread swaps to it under the logger mutex, which is a pointer
+// swap, and hands the old file over. The helper closes it, shifts the
+// backups, renames "<path>.next" to the log path (the open file follows
+// the rename) and opens a new "<path>.next". Until that is done the
+// current file keeps growing past max_file_size. Windows cannot rename an
+// open file, so there rotation stays in place.
+#define LOGGER_ROTATE_RETRY_MS 1000    // Between attempts to open the next file
+
+#ifdef PLATFORM_UNIX
+struct LogRotator {
+    FILE *next_file;                // Pre-opened "<path>.next"
+    LogSegment *next_segment;
+    bool next_ready;
+    FILE *old_file;                 // Swapped out, waiting to be closed
+    LogSegment *old_segment;
+    bool old_pending;
+    bool stop;
+    char next_path[512];
+    pthread_t thread;
+    pthread_mutex_t lock;           // Guards everything above
+    pthread_cond_t wake;            // Signalled on swap and stop
+    pthread_cond_t ready;           // Broadcast when the next file is open
+};
+
+// Wait on cond for at most timeout_ms; false on timeout
+static bool rotator_wait(LogRotator *rotator, pthread_cond_t *cond, int timeout_ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += (long)timeout_ms * 1000000L;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+    return pthread_cond_timedwait(cond, &rotator->lock, &deadline) == 0;
+}
+
+// Helper thread: retire swapped-out files and keep the next one open
+static void* rotator_thread(void *arg) {
+    Logger *logger = (Logger*)arg;
+    LogRotator *rotator = logger->rotator;
+    
+    pthread_mutex_lock(&rotator->lock);
+    while (!rotator->stop || rotator->old_pending) {
+        if (rotator->old_pending) {
+            FILE *file = rotator->old_file;
+            LogSegment *segment = rotator->old_segment;
+            pthread_mutex_unlock(&rotator->lock);
+            
+            close_log_file(file, segment);
+            shift_backups(logger);
+            rename(rotator->next_path, logger->config.log_file_path);
+            
+            pthread_mutex_lock(&rotator->lock);
+            rotator->old_file = NULL;
+            rotator->old_segment = NULL;
+            rotator->old_pending = false;
+        } else if (!rotator->next_ready) {
+            FILE *file;
+            LogSegment *segment;
+            pthread_mutex_unlock(&rotator->lock);
+            open_log_file(logger, rotator->next_path, &file, &segment);
+            pthread_mutex_lock(&rotator->lock);
+            
+            if (file || segment) {
+                rotator->next_file = file;
+                rotator->next_segment = segment;
+                rotator->next_ready = true;
+                pthread_cond_broadcast(&rotator->ready);
+            } else {
+                fprintf(stderr, "Failed to open log file: %s\n", rotator->next_path);
+                rotator_wait(rotator, &rotator->wake, LOGGER_ROTATE_RETRY_MS);
+            }
+        } else {
+            pthread_cond_wait(&rotator->wake, &rotator->lock);
+        }
+    }
+    pthread_mutex_unlock(&rotator->lock);
+    
+    return NULL;
+}
+
+// Start the helper thread
+static bool rotator_start(Logger *logger) {
+    LogRotator *rotator = (LogRotator*)calloc(1, sizeof(LogRotator));
+    if (!rotator) return false;
+    
+    snprintf(rotator->next_path, sizeof(rotator->next_path), "%s.next",
+             logger->config.log_file_path);
+    pthread_mutex_init(&rotator->lock, NULL);
+    pthread_cond_init(&rotator->wake, NULL);
+    pthread_cond_init(&rotator->ready, NULL);
+    logger->rotator = rotator;
+    
+    if (pthread_create(&rotator->thread, NULL, rotator_thread, logger) != 0) {
+        logger->rotator = NULL;
+        pthread_mutex_destroy(&rotator->lock);
+        pthread_cond_destroy(&rotator->wake);
+        pthread_cond_destroy(&rotator->ready);
+        free(rotator);
+        return false;
+    }
+    return true;
+}
+
+// Finish a pending rotation, stop the helper and remove the unused next file
+static void rotator_stop(Logger *logger) {
+    LogRotator *rotator = logger->rotator;
+    
+    pthread_mutex_lock(&rotator->lock);
+    rotator->stop = true;
+    pthread_cond_signal(&rotator->wake);
+    pthread_mutex_unlock(&rotator->lock);
+    pthread_join(rotator->thread, NULL);
+    
+    if (rotator->next_ready) {
+        close_log_file(rotator->next_file, rotator->next_segment);
+        remove(rotator->next_path);
+    }
+    
+    pthread_mutex_destroy(&rotator->lock);
+    pthread_cond_destroy(&rotator->wake);
+    pthread_cond_destroy(&rotator->ready);
+    free(rotator);
+    logger->rotator = NULL;
+}
+
+// Switch to the pre-opened next file; the caller holds the logger mutex.
+// Returns false if it is not open yet, after waiting up to
+// LOGGER_ROTATE_RETRY_MS for it if wait is set.
+static bool rotator_swap(Logger *logger, bool wait) {
+    LogRotator *rotator = logger->rotator;
+    
+    pthread_mutex_lock(&rotator->lock);
+    while (wait && !rotator->next_ready) {
+        if (!rotator_wait(rotator, &rotator->ready, LOGGER_ROTATE_RETRY_MS)) break;
+    }
+    
+    bool swapped = rotator->next_ready;
+    if (swapped) {
+        rotator->old_file = logger->file;
+        rotator->old_segment = logger->segment;
+        rotator->old_pending = true;
+        logger->file = rotator->next_file;
+        logger->segment = rotator->next_segment;
+        logger->current_file_size = 0;
+        rotator->next_file = NULL;
+        rotator->next_segment = NULL;
+        rotator->next_ready = false;
+        pthread_cond_signal(&rotator->wake);
+    }
+    pthread_mutex_unlock(&rotator->lock);
+    
+    return swapped;
+}
+#else
+static bool rotator_start(Logger *logger) {
+    (void)logger;
+    return true;
+}
+
+static void rotator_stop(Logger *logger) { (void)logger; }
+static bool rotator_swap(Logger *logger, bool wait) {
+    (void)logger;
+    (void)wait;
+    return false;
+}
+#endif
+
+// Rotate log file
+void logger_rotate_file(Logger *logger) {
+    if (!logger) return;
+    
+    mutex_lock(logger);
+    if (logger->rotator) {
+        rotator_swap(logger, true);
+    } else if (logger->file || logger->segment) {
+        rotate_file_locked(logger);
+    }
+    mutex_unlock(logger);
+}
+
+// Write the line prefix (timestamp, level tag, file:line) to out and set
+// *tag_offset to where the level tag starts
+static size_t format_prefix(const Logger *logger, LogLevel level, int64_t now,
+                            const char *file, int line, char *out, size_t *tag_offset) {
+    size_t written = 0;
+    
+    if (logger->config.include_timestamp) {
+        written += format_timestamp(logger, now, out);
+    }
+    
+    *tag_offset = written;
+    memcpy(out + written, log_level_tags[level], LOGGER_TAG_LENGTH);
+    written += LOGGER_TAG_LENGTH;
+    
+    if (logger->config.include_file_info) {
+        // Extract filename from path
+        const char *filename = file;
+        const char *last_sep = strrchr(file, '/');
+        if (!last_sep) last_sep = strrchr(file, '\\');
+        if (last_sep) filename = last_sep + 1;
+        
+        // Keep room for the line number and at least the newline
+        size_t name_length = strlen(filename);
+        if (name_length > LOGGER_LINE_MAX / 2) name_length = LOGGER_LINE_MAX / 2;
+        memcpy(out + written, filename, name_length);
+        written += name_length;
+        out[written++] = ':';
+        written += format_uint(out + written, line > 0 ? (unsigned)line : 0);
+        out[written++] = ':';
+        out[written++] = ' ';
+    }
+    
+    return written;
+}
+
+// Account for a message of length bytes (as returned by snprintf into the
+// rest of a LOGGER_LINE_MAX line, minus one byte) and add the newline.
+// Returns the line length.
+static size_t finish_line(char *line, size_t written, int length) {
+    if (length > 0) {
+        written += (size_t)length < LOGGER_LINE_MAX - written - 1
+                 ? (size_t)length : LOGGER_LINE_MAX - written - 2;
+    }
+    line[written++] = '\n';
+    return written;
+}
+
+// Hand a finished line to the writer thread, or write it now
+static void emit_line(Logger *logger, LogLevel level, const char *line,
+                      size_t length, size_t tag_offset) {
+    // Async: FATAL waits for the line to be written, since an abort
+    // usually follows
+    if (logger->async) {
+        if (logger->async->ring) {
+            ring_push_text(logger->async, level, line, length, tag_offset);
+        } else {
+            async_push(logger->async, level, line, length, tag_offset);
+        }
+        if (level >= LOG_FATAL) logger_flush(logger);
+        return;
+    }
+    
+    mutex_lock(logger);
+    write_line(logger, level, line, length, tag_offset, true);
+    mutex_unlock(logger);
+}
+
+// Format a line and emit it, noting suppressed calls (rate limiting) at
+// the end of the message
+static void log_formatted(Logger *logger, LogLevel level, const char *file, int line,
+                          uint64_t suppressed, const char *format, va_list args) {
+    // The line is built in this thread's buffer; only the message itself
+    // goes through printf-style formatting
+    char *full_message = tls_buffer.line;
+    size_t tag_offset;
+    size_t written = format_prefix(logger, level, logger_now_ns(logger), file, line,
+                                   full_message, &tag_offset);
+    
+    // Format message, truncated to leave room for the newline
+    int length = vsnprintf(full_message + written, LOGGER_LINE_MAX - written - 1, format, args);
+    written = finish_line(full_message, written, length);
+    
+    if (suppressed > 0) {
+        written--;  // Back over the newline
+        length = snprintf(full_message + written, LOGGER_LINE_MAX - written - 1,
+                          " (%llu suppressed)", (unsigned long long)suppressed);
+        written = finish_line(full_message, written, length);
+    }
+    
+    emit_line(logger, level, full_message, written, tag_offset);
+}
+
+// Main logging function
+void logger_log(Logger *logger, LogLevel level, const char *file, 
+                int line, const char *format, ...) {
+    if (!logger || level < LOGGER_LEVEL_LOAD(&logger->config.min_level)) return;
     
-    // Format message
-    char message[1024];
     va_list args;
     va_start(args, format);
-    vsnprintf(message, sizeof(message), format, args);
+    log_formatted(logger, level, file, line, 0, format, args);
     va_end(args);
+}
+
+// Rate limiting and sampling
+//
+// LogLimit lives in the call site's static storage, declared in logger.h
+// with plain fields so the header works in C99; these are the only
+// functions that touch it, always atomically.
+#if defined(__GNUC__) || defined(__clang__)
+    #define LIMIT_LOAD(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+    #define LIMIT_ADD(p, n) __atomic_fetch_add((p), (n), __ATOMIC_RELAXED)
+    #define LIMIT_EXCHANGE(p, v) __atomic_exchange_n((p), (v), __ATOMIC_RELAXED)
+    #define LIMIT_CAS(p, expected, desired) __atomic_compare_exchange_n( \
+        (p), (expected), (desired), true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+#else
+    #define LIMIT_LOAD(p) atomic_load_explicit((_Atomic int64_t*)(p), memory_order_relaxed)
+    #define LIMIT_ADD(p, n) atomic_fetch_add_explicit((_Atomic uint64_t*)(p), (n), \
+                                                     memory_order_relaxed)
+    #define LIMIT_EXCHANGE(p, v) atomic_exchange_explicit((_Atomic uint64_t*)(p), (v), \
+                                                         memory_order_relaxed)
+    #define LIMIT_CAS(p, expected, desired) atomic_compare_exchange_weak_explicit( \
+        (_Atomic int64_t*)(p), (expected), (desired), memory_order_relaxed, \
+        memory_order_relaxed)
+#endif
+
+// Token bucket holding up to burst calls, refilled at per_second. Kept as
+// a single timestamp (the generic cell rate algorithm): next_ns moves one
+// interval ahead per call let through, and a call is dropped if that
+// would put it more than burst intervals ahead of now. Both the interval
+// and the burst window saturate at LIMIT_MAX_NS, so next_ns + interval
+// cannot overflow however small the rate or large the burst.
+#define LIMIT_MAX_NS (INT64_MAX / 4)
+
+bool logger_limit_rate(LogLimit *limit, double per_second, int burst, uint64_t *suppressed) {
+    int64_t now = clock_now_ns();
+    int64_t interval = per_second > 1e9 / LIMIT_MAX_NS ? (int64_t)(1e9 / per_second)
+                                                       : LIMIT_MAX_NS;
+    int64_t calls = burst > 1 ? burst : 1;
+    int64_t allowed = interval > LIMIT_MAX_NS / calls ? LIMIT_MAX_NS : interval * calls;
+    int64_t next = LIMIT_LOAD(&limit->next_ns);
     
-    // Prepare full log line
-    char full_message[2048];
-    int written = 0;
+    for (;;) {
+        int64_t start = next > now ? next : now;
+        if (start + interval - now > allowed) {
+            LIMIT_ADD(&limit->suppressed, 1);
+            return false;
+        }
+        if (LIMIT_CAS(&limit->next_ns, &next, start + interval)) break;
+    }
     
-    if (logger->config.include_timestamp) {
-        written += snprintf(full_message + written, 
-                           sizeof(full_message) - written,
-                           "[%s] ", time_str);
-    }
-    
-    if (logger->config.use_colors && logger->config.log_to_console) {
-        written += snprintf(full_message + written, 
-                           sizeof(full_message) - written,
-                           "%s[%-5s]%s ", 
-                           log_level_colors[level], 
-                           log_level_names[level], 
-                           COLOR_RESET);
+    *suppressed = LIMIT_EXCHANGE(&limit->suppressed, 0);
+    return true;
+}
+
+// Let through the first call and every every-th one after it
+bool logger_limit_sample(LogLimit *limit, unsigned every, uint64_t *suppressed) {
+    uint64_t call = LIMIT_ADD(&limit->calls, 1);
+    if (every <= 1) {
+        *suppressed = 0;
+        return true;
+    }
+    if (call % every != 0) return false;
+    
+    *suppressed = call == 0 ? 0 : every - 1;
+    return true;
+}
+
+// logger_log for LOG_RATE_LIMITED / LOG_SAMPLED: the line ends with
+// "(N suppressed)" if suppressed is nonzero
+void logger_log_suppressed(Logger *logger, LogLevel level, const char *file, int line,
+                           uint64_t suppressed, const char *format, ...) {
+    if (!logger || level < LOGGER_LEVEL_LOAD(&logger->config.min_level)) return;
+    
+    va_list args;
+    va_start(args, format);
+    log_formatted(logger, level, file, line, suppressed, format, args);
+    va_end(args);
+}
+
+// Binary mode
+//
+// logger_log_binary copies the format pointer, the call site and the raw
+// argument values into a ring buffer shared by all threads; the writer
+// thread decodes and formats them. Lines that were formatted anyway (a
+// format that is not a literal) go through the same ring as text, so the
+// output keeps call order. A producer claims space by advancing the write
+// position with a CAS, fills it in, then publishes the record by storing
+// its size. The writer consumes records in position order, zeroes them and
+// advances the read position. A full ring makes producers wait.
+#define LOGGER_RING_SIZE (1 << 20)          // Bytes; a power of two
+#define LOGGER_RING_ALIGN(n) (((n) + 7) & ~(size_t)7)
+
+enum { LOG_RING_FILLER = 1, LOG_RING_BINARY, LOG_RING_TEXT };
+
+typedef struct {
+    _Atomic uint32_t size;      // Whole record, 8-aligned; 0 until published
+    uint16_t kind;              // Filler records only set size and kind
+    uint16_t level;
+    const LogSite *site;        // Binary records
+    const char *format;
+    int64_t time_ns;
+} LogRingRecord;                // Followed by the arguments, or the text
+
+struct LogRing {
+    char *buffer;
+    atomic_size_t write_pos;    // Positions only grow; index = pos % size
+    atomic_size_t read_pos;
+};
+
+static LogRing* ring_create(void) {
+    LogRing *ring = (LogRing*)calloc(1, sizeof(LogRing));
+    if (!ring) return NULL;
+    
+    ring->buffer = (char*)calloc(1, LOGGER_RING_SIZE);
+    if (!ring->buffer) {
+        free(ring);
+        return NULL;
+    }
+    return ring;
+}
+
+static void ring_destroy(LogRing *ring) {
+    if (ring) {
+        free(ring->buffer);
+        free(ring);
+    }
+}
+
+// Argument types as the format uses them. The call site types each pointer
+// as a string ('s', for char pointers) or not ('p'), but only a %s
+// conversion reads through a pointer after the call returns, so a pointer
+// is copied as a string exactly when its conversion is %s. types gets
+// strlen(signature) + 1 bytes. precisions, if given, gets each %s
+// precision: -1 for none, -2 when it is the preceding int argument (.*).
+// Returns false for wide conversions (%ls, %lc), which can't be copied
+// here and have to be formatted on the caller's thread.
+static bool binary_arg_types(const char *f, const char *signature, char *types,
+                             int *precisions) {
+    strcpy(types, signature);
+    char *t = types;
+    
+    while (*t && (f = strchr(f, '%')) != NULL) {
+        f++;
+        if (*f == '%') {
+            f++;
+            continue;
+        }
+        
+        int precision = -1;
+        while (*f && strchr("-+ #0'", *f)) f++;
+        if (*f == '*') {
+            if (*t == 'i') t++;
+            f++;
+        }
+        while (isdigit((unsigned char)*f)) f++;
+        if (*f == '.') {
+            f++;
+            if (*f == '*') {
+                if (*t == 'i') {
+                    precision = -2;
+                    t++;
+                }
+                f++;
+            } else {
+                precision = 0;
+                while (isdigit((unsigned char)*f)) {
+                    if (precision <= LOGGER_LINE_MAX) precision = precision * 10 + (*f - '0');
+                    f++;
+                }
+            }
+        }
+        
+        bool wide = false;
+        while (*f && strchr("hlLqjzt", *f)) wide |= *f++ == 'l';
+        if (!*f || !*t) break;
+        if (*f == 'S' || *f == 'C' || (wide && (*f == 's' || *f == 'c'))) return false;
+        
+        if (*t == 's' || *t == 'p') *t = *f == 's' ? 's' : 'p';
+        if (precisions) precisions[t - types] = precision;
+        t++;
+        f++;
+    }
+    return true;
+}
+
+// Bytes of a %s argument a record keeps: no more than its precision (see
+// binary_arg_types; star is the preceding int argument) or LOGGER_LINE_MAX,
+// and never past the end of a string that isn't NUL-terminated within it
+static size_t binary_string_length(const char *str, int precision, int64_t star) {
+    size_t max = LOGGER_LINE_MAX;
+    if (precision == -2) precision = star < 0 ? -1 : star < LOGGER_LINE_MAX ? (int)star : LOGGER_LINE_MAX;
+    if (precision >= 0 && (size_t)precision < max) max = (size_t)precision;
+    return strnlen(str ? str : "(null)", max);
+}
+
+// Encoded size of the arguments described by types (format excluded)
+static size_t binary_args_size(const char *types, const int *precisions, va_list args) {
+    size_t size = 0;
+    int64_t star = -1;
+    
+    for (const char *t = types; *t; t++) {
+        switch (*t) {
+            case 'i': star = va_arg(args, int); size += 8; break;
+            case 'I': (void)va_arg(args, unsigned int); size += 8; break;
+            case 'l': (void)va_arg(args, long); size += 8; break;
+            case 'L': (void)va_arg(args, unsigned long); size += 8; break;
+            case 'q': (void)va_arg(args, long long); size += 8; break;
+            case 'Q': (void)va_arg(args, unsigned long long); size += 8; break;
+            case 'd': (void)va_arg(args, double); size += 8; break;
+            case 'D': (void)va_arg(args, long double);
+                      size += LOGGER_RING_ALIGN(sizeof(long double)); break;
+            case 's': {
+                const char *str = va_arg(args, const char*);
+                size += LOGGER_RING_ALIGN(8 + binary_string_length(str, precisions[t - types], star));
+                break;
+            }
+            default: (void)va_arg(args, void*); size += 8; break;
+        }
+    }
+    return size;
+}
+
+// Copy the arguments into a record: 8 bytes per scalar, strings as an
+// 8-byte length and their bytes
+static void binary_args_encode(char *out, const char *types, const int *precisions,
+                               va_list args) {
+    int64_t star = -1;
+    
+    for (const char *t = types; *t; t++) {
+        int64_t i = 0;
+        uint64_t u = 0;
+        double d;
+        
+        switch (*t) {
+            case 'i': i = star = va_arg(args, int); memcpy(out, &i, 8); out += 8; break;
+            case 'I': u = va_arg(args, unsigned int); memcpy(out, &u, 8); out += 8; break;
+            case 'l': i = va_arg(args, long); memcpy(out, &i, 8); out += 8; break;
+            case 'L': u = va_arg(args, unsigned long); memcpy(out, &u, 8); out += 8; break;
+            case 'q': i = va_arg(args, long long); memcpy(out, &i, 8); out += 8; break;
+            case 'Q': u = va_arg(args, unsigned long long); memcpy(out, &u, 8); out += 8; break;
+            case 'd': d = va_arg(args, double); memcpy(out, &d, 8); out += 8; break;
+            case 'D': {
+                long double ld = va_arg(args, long double);
+                memcpy(out, &ld, sizeof(ld));
+                out += LOGGER_RING_ALIGN(sizeof(ld));
+                break;
+            }
+            case 's': {
+                const char *str = va_arg(args, const char*);
+                uint64_t length = binary_string_length(str, precisions[t - types], star);
+                if (!str) str = "(null)";
+                memcpy(out, &length, 8);
+                memcpy(out + 8, str, length);
+                out += LOGGER_RING_ALIGN(8 + length);
+                break;
+            }
+            default: {
+                void *ptr = va_arg(args, void*);
+                memcpy(out, &ptr, sizeof(ptr));
+                out += 8;
+                break;
+            }
+        }
+    }
+}
+
+// Claim size bytes, plus a filler record if they would straddle the end
+static LogRingRecord* ring_claim(LogAsync *async, size_t size) {
+    LogRing *ring = async->ring;
+    size_t pos, skip;
+    
+    for (;;) {
+        pos = atomic_load_explicit(&ring->write_pos, memory_order_relaxed);
+        size_t index = pos & (LOGGER_RING_SIZE - 1);
+        skip = index + size > LOGGER_RING_SIZE ? LOGGER_RING_SIZE - index : 0;
+        
+        if (pos + skip + size - atomic_load_explicit(&ring->read_pos, memory_order_acquire) >
+            LOGGER_RING_SIZE) {
+            async_wake(async); // Full: let the writer catch up
+            thread_yield();
+            continue;
+        }
+        if (atomic_compare_exchange_weak(&ring->write_pos, &pos, pos + skip + size)) break;
+    }
+    
+    if (skip > 0) {
+        LogRingRecord *filler = (LogRingRecord*)(ring->buffer + (pos & (LOGGER_RING_SIZE - 1)));
+        filler->kind = LOG_RING_FILLER;
+        atomic_store_explicit(&filler->size, (uint32_t)skip, memory_order_release);
+        pos += skip;
+    }
+    return (LogRingRecord*)(ring->buffer + (pos & (LOGGER_RING_SIZE - 1)));
+}
+
+// Make a filled-in record visible to the writer
+static void ring_publish(LogAsync *async, LogRingRecord *record, size_t size) {
+    atomic_fetch_add(&async->pushed, 1);
+    atomic_store_explicit(&record->size, (uint32_t)size, memory_order_release);
+    async_wake_if_sleeping(async);
+}
+
+// Queue an already formatted line
+static void ring_push_text(LogAsync *async, LogLevel level, const char *line,
+                           size_t length, size_t tag_offset) {
+    size_t size = sizeof(LogRingRecord) + LOGGER_RING_ALIGN(8 + length);
+    LogRingRecord *record = ring_claim(async, size);
+    
+    uint32_t header[2] = { (uint32_t)length, (uint32_t)tag_offset };
+    record->kind = LOG_RING_TEXT;
+    record->level = (uint16_t)level;
+    memcpy(record + 1, header, 8);
+    memcpy((char*)(record + 1) + 8, line, length);
+    ring_publish(async, record, size);
+}
+
+// Record a log call without formatting it. Used by the LOG_* macros when
+// LogConfig.binary is set; site->signature types the format and every
+// argument.
+void logger_log_binary(Logger *logger, const LogSite *site, const char *format, ...) {
+    if (!logger || site->level < LOGGER_LEVEL_LOAD(&logger->config.min_level)) return;
+    
+    LogRing *ring = logger->async ? logger->async->ring : NULL;
+    if (!ring) return;
+    
+    char types[LOGGER_MAX_ARGS];
+    int precisions[LOGGER_MAX_ARGS];
+    va_list args;
+    if (!binary_arg_types(format, site->signature + 1, types, precisions)) {
+        va_start(args, format);
+        log_formatted(logger, site->level, site->file, site->line, 0, format, args);
+        va_end(args);
+        return;
+    }
+    
+    va_start(args, format);
+    size_t size = sizeof(LogRingRecord) + binary_args_size(types, precisions, args);
+    va_end(args);
+    
+    LogRingRecord *record = ring_claim(logger->async, size);
+    record->kind = LOG_RING_BINARY;
+    record->level = (uint16_t)site->level;
+    record->site = site;
+    record->format = format;
+    record->time_ns = logger_now_ns(logger);
+    
+    va_start(args, format);
+    binary_args_encode((char*)(record + 1), types, precisions, args);
+    va_end(args);
+    
+    ring_publish(logger->async, record, size);
+    
+    if (site->level >= LOG_FATAL) logger_flush(logger);
+}
+
+// Bytes binary_args_encode used for the argument of the given type at arg
+static size_t binary_arg_width(const char *arg, char type) {
+    if (type == 'D') return LOGGER_RING_ALIGN(sizeof(long double));
+    if (type != 's') return 8;
+    
+    uint64_t length;
+    memcpy(&length, arg, 8);
+    return LOGGER_RING_ALIGN(8 + length);
+}
+
+// Format the message of a ring record into out (at most size bytes,
+// including the NUL). Each conversion in the format is handed to snprintf
+// on its own with the argument type logger_log_binary encoded.
+static int binary_format_message(const LogRingRecord *record, char *out, size_t size) {
+    const char *f = record->format;
+    char arg_types[LOGGER_MAX_ARGS];
+    binary_arg_types(f, record->site->signature + 1, arg_types, NULL);
+    const char *types = arg_types;
+    const char *arg = (const char*)(record + 1);
+    size_t n = 0;
+    
+#define LOGGER_TAKE(type, dst) do { type _v; memcpy(&_v, arg, sizeof(_v)); (dst) = _v; arg += 8; } while (0)
+    
+    while (*f && n + 1 < size) {
+        if (*f != '%') {
+            out[n++] = *f++;
+            continue;
+        }
+        if (f[1] == '%') {
+            out[n++] = '%';
+            f += 2;
+            continue;
+        }
+        
+        // Copy one conversion spec: flags, width, precision, length, type
+        char spec[32];
+        size_t k = 0;
+        int stars[2];
+        int star_count = 0;
+        bool usable = true;
+        spec[k++] = *f++;
+        while (*f && strchr("-+ #0'", *f) && k < sizeof(spec) - 2) spec[k++] = *f++;
+        while (*f && (isdigit((unsigned char)*f) || *f == '.' || *f == '*') &&
+               k < sizeof(spec) - 2) {
+            if (*f == '*') {
+                if (star_count < 2 && *types == 'i') {
+                    int64_t v;
+                    LOGGER_TAKE(int64_t, v);
+                    stars[star_count++] = (int)v;
+                    types++;
+                } else {
+                    usable = false;
+                }
+            }
+            spec[k++] = *f++;
+        }
+        while (*f && strchr("hlLqjzt", *f) && k < sizeof(spec) - 2) spec[k++] = *f++;
+        if (!*f) break;
+        char conversion = *f++;
+        spec[k++] = conversion;
+        spec[k] = '\0';
+        
+        if (conversion == 'n') {    // Not supported: skip its argument
+            if (*types) arg += binary_arg_width(arg, *types++);
+            continue;
+        }
+        // More conversions than arguments, or %s without a copied string
+        if (!*types || !usable || (conversion == 's' && *types != 's')) {
+            if (*types && usable) arg += binary_arg_width(arg, *types++);
+            size_t length = strlen(spec);
+            if (length > size - 1 - n) length = size - 1 - n;
+            memcpy(out + n, spec, length);
+            n += length;
+            continue;
+        }
+        
+        char *dst = out + n;
+        size_t room = size - n;
+        int len = 0;
+#define LOGGER_EMIT(value) \
+        (star_count == 0 ? snprintf(dst, room, spec, value) : \
+         star_count == 1 ? snprintf(dst, room, spec, stars[0], value) : \
+                           snprintf(dst, room, spec, stars[0], stars[1], value))
+        
+        switch (*types++) {
+            case 'i': { int64_t v; LOGGER_TAKE(int64_t, v); len = LOGGER_EMIT((int)v); break; }
+            case 'I': { uint64_t v; LOGGER_TAKE(uint64_t, v); len = LOGGER_EMIT((unsigned int)v); break; }
+            case 'l': { int64_t v; LOGGER_TAKE(int64_t, v); len = LOGGER_EMIT((long)v); break; }
+            case 'L': { uint64_t v; LOGGER_TAKE(uint64_t, v); len = LOGGER_EMIT((unsigned long)v); break; }
+            case 'q': { int64_t v; LOGGER_TAKE(int64_t, v); len = LOGGER_EMIT((long long)v); break; }
+            case 'Q': { uint64_t v; LOGGER_TAKE(uint64_t, v); len = LOGGER_EMIT((unsigned long long)v); break; }
+            case 'd': { double v; LOGGER_TAKE(double, v); len = LOGGER_EMIT(v); break; }
+            case 'D': {
+                long double v;
+                memcpy(&v, arg, sizeof(v));
+                arg += LOGGER_RING_ALIGN(sizeof(v));
+                len = LOGGER_EMIT(v);
+                break;
+            }
+            case 's': {
+                uint64_t length;
+                memcpy(&length, arg, 8);
+                char text[LOGGER_LINE_MAX + 1];
+                memcpy(text, arg + 8, length);
+                text[length] = '\0';
+                arg += LOGGER_RING_ALIGN(8 + length);
+                len = LOGGER_EMIT(text);
+                break;
+            }
+            default: { void *v; memcpy(&v, arg, sizeof(v)); arg += 8; len = LOGGER_EMIT(v); break; }
+        }
+#undef LOGGER_EMIT
+        
+        if (len > 0) n += (size_t)len < room ? (size_t)len : room - 1;
+    }
+#undef LOGGER_TAKE
+    
+    out[n] = '\0';
+    return (int)n;
+}
+
+// Writer thread: decode and write up to max published records; returns
+// how many were written. The caller holds the logger mutex.
+static size_t ring_drain(Logger *logger, LogRing *ring, size_t max) {
+    char *line = tls_buffer.line;
+    size_t count = 0;
+    
+    while (count < max) {
+        size_t pos = atomic_load_explicit(&ring->read_pos, memory_order_relaxed);
+        LogRingRecord *record = (LogRingRecord*)(ring->buffer + (pos & (LOGGER_RING_SIZE - 1)));
+        uint32_t size = atomic_load_explicit(&record->size, memory_order_acquire);
+        if (size == 0) break;
+        
+        if (record->kind == LOG_RING_BINARY) {
+            const LogSite *site = record->site;
+            size_t tag_offset;
+            size_t written = format_prefix(logger, site->level, record->time_ns,
+                                           site->file, site->line, line, &tag_offset);
+            int length = binary_format_message(record, line + written,
+                                               LOGGER_LINE_MAX - written - 1);
+            written = finish_line(line, written, length);
+            write_line(logger, site->level, line, written, tag_offset, false);
+            count++;
+        } else if (record->kind == LOG_RING_TEXT) {
+            uint32_t header[2];     // Length, tag offset
+            memcpy(header, record + 1, 8);
+            write_line(logger, (LogLevel)record->level, (const char*)(record + 1) + 8,
+                       header[0], header[1], false);
+            count++;
+        }
+        
+        // Producers expect claimed space to read as zero
+        memset(record, 0, size);
+        atomic_store_explicit(&ring->read_pos, pos + size, memory_order_release);
+    }
+    return count;
+}
+
+static bool ring_empty(LogRing *ring) {
+    return atomic_load(&ring->read_pos) == atomic_load(&ring->write_pos);
+}
+
+// Timers
+//
+// Each thread that records a timer gets a LogTimerThread, linked into a
+// list that is only ever pushed to (blocks of exited threads are kept, so
+// their counts still show up). It maps LogTimer sites to histograms with
+// open addressing; only the owner inserts or counts, the reporter reads.
+// Histograms are log-linear: exact below 32 ticks, then 16 buckets per
+// power of two (about 6% resolution). Reports log the difference from the
+// counts at the previous report. logger_destroy frees all of it; a thread
+// that records again afterwards sees a new generation and starts a fresh
+// block instead of using the one it cached.
+#define LOGGER_MAX_TIMERS 64            // Per thread and overall; a power of two
+#define LOGGER_HIST_SUB 16              // Buckets per power of two
+#define LOGGER_HIST_BUCKETS (61 * LOGGER_HIST_SUB)     // Up to 2^64 - 1
+#define LOGGER_TSC_CALIBRATE_NS 5000000 // Spent measuring the TSC once
+
+typedef struct {
+    atomic_uint_least64_t counts[LOGGER_HIST_BUCKETS];
+} LogHistogram;
+
+typedef struct LogTimerThread {
+    struct LogTimerThread *next;
+    _Atomic(const LogTimer*) timers[LOGGER_MAX_TIMERS];
+    LogHistogram *histograms[LOGGER_MAX_TIMERS];    // Set before timers[i]
+} LogTimerThread;
+
+// Reporter-side totals for one timer
+typedef struct {
+    const LogTimer *timer;
+    uint64_t reported[LOGGER_HIST_BUCKETS];     // Counts at the last report
+    uint64_t current[LOGGER_HIST_BUCKETS];
+} LogTimerTotals;
+
+static _Atomic(LogTimerThread*) timer_threads;
+static atomic_uint timer_generation;                        // Bumped when freed
+static LOGGER_THREAD_LOCAL LogTimerThread *tls_timers;
+static LOGGER_THREAD_LOCAL unsigned tls_timers_generation;
+static LogTimerTotals *timer_totals[LOGGER_MAX_TIMERS];     // Reporter only
+static atomic_flag timer_reporting = ATOMIC_FLAG_INIT;
+static atomic_uint_least64_t timer_next_report;             // In ticks
+static _Atomic double timer_ns_per_tick;                    // 0 until known
+
+// Raw monotonic clock (no NTP slewing) in nanoseconds
+static int64_t clock_raw_ns(void) {
+#ifdef PLATFORM_WINDOWS
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (int64_t)(counter.QuadPart / frequency.QuadPart * 1000000000 +
+                     counter.QuadPart % frequency.QuadPart * 1000000000 / frequency.QuadPart);
+#else
+    struct timespec ts;
+#ifdef CLOCK_MONOTONIC_RAW
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+#ifndef LOGGER_TIMER_TSC
+uint64_t logger_ticks(void) {
+    return (uint64_t)clock_raw_ns();
+}
+#endif
+
+// Nanoseconds per tick, measuring the TSC against the raw clock the first
+// time (logger_create does this, so timed code does not wait for it)
+static double timer_tick_ns(void) {
+    double ns_per_tick = atomic_load_explicit(&timer_ns_per_tick, memory_order_relaxed);
+    if (ns_per_tick > 0) return ns_per_tick;
+    
+#ifdef LOGGER_TIMER_TSC
+    int64_t start_ns = clock_raw_ns(), end_ns;
+    uint64_t start = logger_ticks();
+    while ((end_ns = clock_raw_ns()) - start_ns < LOGGER_TSC_CALIBRATE_NS) {}
+    ns_per_tick = (double)(end_ns - start_ns) / (double)(logger_ticks() - start);
+#else
+    ns_per_tick = 1.0;
+#endif
+    atomic_store_explicit(&timer_ns_per_tick, ns_per_tick, memory_order_relaxed);
+    return ns_per_tick;
+}
+
+static int highest_bit(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(value);
+#else
+    int bit = 0;
+    while (value >>= 1) bit++;
+    return bit;
+#endif
+}
+
+// Histogram bucket of a value, and the range of values in a bucket
+static size_t histogram_bucket(uint64_t value) {
+    if (value < 2 * LOGGER_HIST_SUB) return (size_t)value;
+    int shift = highest_bit(value) - 4;     // Leaves value >> shift in [16, 32)
+    return (size_t)shift * LOGGER_HIST_SUB + (size_t)(value >> shift);
+}
+
+static uint64_t histogram_bucket_start(size_t bucket) {
+    if (bucket < 2 * LOGGER_HIST_SUB) return bucket;
+    size_t shift = bucket / LOGGER_HIST_SUB - 1;
+    return (uint64_t)(bucket % LOGGER_HIST_SUB + LOGGER_HIST_SUB) << shift;
+}
+
+static uint64_t histogram_bucket_width(size_t bucket) {
+    if (bucket < 2 * LOGGER_HIST_SUB) return 1;
+    return (uint64_t)1 << (bucket / LOGGER_HIST_SUB - 1);
+}
+
+// The calling thread's histogram for timer, NULL if its table is full
+static LogHistogram* timer_histogram(const LogTimer *timer) {
+    LogTimerThread *thread = tls_timers;
+    unsigned generation = atomic_load_explicit(&timer_generation, memory_order_relaxed);
+    if (!thread || tls_timers_generation != generation) {
+        thread = (LogTimerThread*)calloc(1, sizeof(LogTimerThread));
+        if (!thread) return NULL;
+        
+        thread->next = atomic_load(&timer_threads);
+        while (!atomic_compare_exchange_weak(&timer_threads, &thread->next, thread)) {}
+        tls_timers = thread;
+        tls_timers_generation = generation;
+    }
+    
+    size_t slot = ((uintptr_t)timer >> 4) & (LOGGER_MAX_TIMERS - 1);
+    for (int probe = 0; probe < LOGGER_MAX_TIMERS; probe++) {
+        const LogTimer *owner = atomic_load_explicit(&thread->timers[slot], memory_order_relaxed);
+        if (owner == timer) return thread->histograms[slot];
+        
+        if (!owner) {
+            LogHistogram *histogram = (LogHistogram*)calloc(1, sizeof(LogHistogram));
+            if (!histogram) return NULL;
+            thread->histograms[slot] = histogram;
+            atomic_store_explicit(&thread->timers[slot], timer, memory_order_release);
+            return histogram;
+        }
+        slot = (slot + 1) & (LOGGER_MAX_TIMERS - 1);
+    }
+    return NULL;
+}
+
+// Add one measurement; called by LOG_TIMER_END
+void logger_timer_record(const LogTimer *timer, uint64_t ticks) {
+    LogHistogram *histogram = timer_histogram(timer);
+    if (histogram) {
+        // Only this thread writes, so no atomic read-modify-write is needed
+        atomic_uint_least64_t *count = &histogram->counts[histogram_bucket(ticks)];
+        atomic_store_explicit(count, atomic_load_explicit(count, memory_order_relaxed) + 1,
+                              memory_order_relaxed);
+    }
+    
+    Logger *logger = g_logger;
+    if (!logger) return;
+    
+    // Without periodic reports every measurement is logged on its own
+    if (logger->config.timer_report_ms <= 0) {
+        if (LOGGER_ENABLED(logger, LOG_DEBUG)) {
+            logger_log(logger, LOG_DEBUG, timer->file, timer->line,
+                       "Timer [%s] elapsed: %.3f seconds", timer->name,
+                       (double)ticks * timer_tick_ns() / 1e9);
+        }
+        return;
+    }
+    
+    // Periodic report, by whichever thread notices it is due
+    
+    uint64_t now = logger_ticks();
+    uint64_t due = atomic_load_explicit(&timer_next_report, memory_order_relaxed);
+    if (now < due) return;
+    
+    uint64_t interval = (uint64_t)(logger->config.timer_report_ms * 1e6 / timer_tick_ns());
+    if (atomic_compare_exchange_strong(&timer_next_report, &due, now + interval) && due != 0) {
+        logger_timer_report(logger);
+    }
+}
+
+// Append a duration with a readable unit
+static void format_duration(char *out, size_t size, double ns) {
+    if (ns < 1e3) {
+        snprintf(out, size, "%.0fns", ns);
+    } else if (ns < 1e6) {
+        snprintf(out, size, "%.2fus", ns / 1e3);
+    } else if (ns < 1e9) {
+        snprintf(out, size, "%.2fms", ns / 1e6);
     } else {
-        written += snprintf(full_message + written, 
-                           sizeof(full_message) - written,
-                           "[%-5s] ", log_level_names[level]);
+        snprintf(out, size, "%.2fs", ns / 1e9);
     }
+}
+
+// Value at quantile q of counts, as the middle of its bucket
+static double histogram_quantile(const uint64_t *counts, uint64_t total, double q) {
+    uint64_t rank = (uint64_t)(q * (double)total + 0.999999);
+    uint64_t seen = 0;
+    size_t bucket = 0;
     
-    if (logger->config.include_file_info) {
-        written += snprintf(full_message + written, 
-                           sizeof(full_message) - written,
-                           "%s:%d: ", filename, line);
+    if (rank == 0) rank = 1;
+    for (; bucket < LOGGER_HIST_BUCKETS - 1; bucket++) {
+        seen += counts[bucket];
+        if (seen >= rank) break;
     }
     
-    written += snprintf(full_message + written, 
-                       sizeof(full_message) - written,
-                       "%s\n", message);
+    return (double)histogram_bucket_start(bucket) +
+           (double)(histogram_bucket_width(bucket) - 1) / 2;
+}
+
+// Log p50/p99/p999 of every timer recorded since the last report. Reports
+// do not overlap: a call made while one runs returns at once.
+void logger_timer_report(Logger *logger) {
+    if (!logger || atomic_flag_test_and_set(&timer_reporting)) return;
     
-    // Output to console
-    if (logger->config.log_to_console) {
-        FILE *output = (level >= LOG_ERROR) ? stderr : stdout;
-        fprintf(output, "%s", full_message);
-        fflush(output);
+    double ns_per_tick = timer_tick_ns();
+    for (int i = 0; i < LOGGER_MAX_TIMERS && timer_totals[i]; i++) {
+        memset(timer_totals[i]->current, 0, sizeof(timer_totals[i]->current));
     }
     
-    // Output to file
-    if (logger->file) {
-        // Remove color codes for file output
-        if (logger->config.use_colors) {
-            char clean_message[2048];
-            int j = 0;
-            bool in_escape = false;
+    // Merge every thread's histograms into the totals
+    for (LogTimerThread *thread = atomic_load(&timer_threads); thread; thread = thread->next) {
+        for (int slot = 0; slot < LOGGER_MAX_TIMERS; slot++) {
+            const LogTimer *timer = atomic_load_explicit(&thread->timers[slot],
+                                                         memory_order_acquire);
+            if (!timer) continue;
             
-            for (int i = 0; full_message[i] && j < sizeof(clean_message) - 1; i++) {
-                if (full_message[i] == '\x1b') {
-                    in_escape = true;
-                } else if (in_escape && full_message[i] == 'm') {
-                    in_escape = false;
-                } else if (!in_escape) {
-                    clean_message[j++] = full_message[i];
-                }
+            int i = 0;
+            while (i < LOGGER_MAX_TIMERS && timer_totals[i] && timer_totals[i]->timer != timer) i++;
+            if (i == LOGGER_MAX_TIMERS) continue;
+            if (!timer_totals[i]) {
+                timer_totals[i] = (LogTimerTotals*)calloc(1, sizeof(LogTimerTotals));
+                if (!timer_totals[i]) continue;
+                timer_totals[i]->timer = timer;
             }
-            clean_message[j] = '\0';
             
-            fprintf(logger->file, "%s", clean_message);
-            logger->current_file_size += strlen(clean_message);
-        } else {
-            fprintf(logger->file, "%s", full_message);
-            logger->current_file_size += written;
+            LogHistogram *histogram = thread->histograms[slot];
+            for (size_t b = 0; b < LOGGER_HIST_BUCKETS; b++) {
+                timer_totals[i]->current[b] += atomic_load_explicit(&histogram->counts[b],
+                                                                    memory_order_relaxed);
+            }
         }
+    }
+    
+    for (int i = 0; i < LOGGER_MAX_TIMERS && timer_totals[i]; i++) {
+        LogTimerTotals *totals = timer_totals[i];
+        uint64_t delta[LOGGER_HIST_BUCKETS];
+        uint64_t total = 0;
+        size_t last = 0;
         
-        fflush(logger->file);
+        for (size_t b = 0; b < LOGGER_HIST_BUCKETS; b++) {
+            delta[b] = totals->current[b] - totals->reported[b];
+            totals->reported[b] = totals->current[b];
+            total += delta[b];
+            if (delta[b]) last = b;
+        }
+        if (total == 0) continue;
         
-        // Check if rotation is needed
-        if (logger->config.max_file_size > 0 && 
-            logger->current_file_size >= logger->config.max_file_size) {
-            logger_rotate_file(logger);
+        char p50[32], p99[32], p999[32], max[32];
+        format_duration(p50, sizeof(p50), histogram_quantile(delta, total, 0.50) * ns_per_tick);
+        format_duration(p99, sizeof(p99), histogram_quantile(delta, total, 0.99) * ns_per_tick);
+        format_duration(p999, sizeof(p999), histogram_quantile(delta, total, 0.999) * ns_per_tick);
+        format_duration(max, sizeof(max),
+                        (double)(histogram_bucket_start(last) +
+                                 histogram_bucket_width(last) - 1) * ns_per_tick);
+        logger_log(logger, LOG_INFO, __FILE__, __LINE__,
+                   "Timer [%s] count=%llu p50=%s p99=%s p999=%s max<=%s",
+                   totals->timer->name, (unsigned long long)total, p50, p99, p999, max);
+    }
+    
+    atomic_flag_clear(&timer_reporting);
+}
+
+// Free every thread's timer block and the report totals. Called by
+// logger_destroy; as with logging, no thread may record timers meanwhile.
+static void timer_free_all(void) {
+    LogTimerThread *thread = atomic_exchange(&timer_threads, NULL);
+    while (thread) {
+        LogTimerThread *next = thread->next;
+        for (int slot = 0; slot < LOGGER_MAX_TIMERS; slot++) {
+            free(thread->histograms[slot]);
         }
+        free(thread);
+        thread = next;
     }
     
-    mutex_unlock(logger);
+    for (int i = 0; i < LOGGER_MAX_TIMERS; i++) {
+        free(timer_totals[i]);
+        timer_totals[i] = NULL;
+    }
+    atomic_store(&timer_next_report, 0);
+    atomic_fetch_add(&timer_generation, 1);
 }
 
 // Set minimum log level
 void logger_set_level(Logger *logger, LogLevel level) {
     if (!logger) return;
-    mutex_lock(logger);
-    logger->config.min_level = level;
-    mutex_unlock(logger);
+    LOGGER_LEVEL_STORE(&logger->config.min_level, level);
 }
 
 // Enable/disable colors
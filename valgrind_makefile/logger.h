@@ -7,6 +7,7 @@
 #include <time.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifdef _WIN32
     #define PLATFORM_WINDOWS
@@ -60,8 +61,32 @@ typedef struct {
     char log_file_path[256];
     size_t max_file_size;
     int max_backup_files;
+    bool async;             // Hand lines to a writer thread (see logger_flush)
+    bool precise_timestamp; // Add microseconds to timestamps
+    bool binary;            // LOG_* macros defer formatting to the writer thread
+    bool mmap_file;         // Append to the log file through a mapping (Unix)
+    bool background_rotation;   // Rotate by swapping to a pre-opened file (Unix)
+    int timer_report_ms;    // Log LOG_TIMER percentiles this often (0: log each
+                            // measurement at LOG_DEBUG instead)
 } LogConfig;
 
+// Writer thread state for async and binary mode (private to logger.c)
+typedef struct LogAsync LogAsync;
+
+// Memory-mapped log file (private to logger.c)
+typedef struct LogSegment LogSegment;
+
+// Background rotation thread state (private to logger.c)
+typedef struct LogRotator LogRotator;
+
+// A LOG_* call site, for binary mode
+typedef struct {
+    const char *file;
+    int line;
+    LogLevel level;
+    const char *signature;  // Type code of the format and of each argument
+} LogSite;
+
 // Logger structure
 typedef struct {
     LogConfig config;
@@ -72,6 +97,12 @@ typedef struct {
 #else
     pthread_mutex_t mutex;
 #endif
+    LogAsync *async;        // NULL unless config.async
+    LogSegment *segment;    // Used instead of file when config.mmap_file
+    LogRotator *rotator;    // NULL unless config.background_rotation
+    int64_t clock_offset_ns;    // Wall clock minus the monotonic clock
+    uint64_t mutex_waits;       // Times mutex was contended (updated under it)
+    uint64_t mutex_wait_ns;     // Time spent waiting for it
 } Logger;
 
 // Global logger instance
@@ -88,20 +119,167 @@ void logger_log(Logger *logger, LogLevel level, const char *file,
 void logger_set_level(Logger *logger, LogLevel level);
 void logger_enable_colors(Logger *logger, bool enable);
 void logger_rotate_file(Logger *logger);
+void logger_flush(Logger *logger);
+void logger_log_binary(Logger *logger, const LogSite *site, const char *format, ...);
+
+// Level checks
+//
+// LOG_* calls below LOGGER_MIN_LEVEL are compiled out: the call, its static
+// data and its arguments are dead code (they are still type-checked). Build
+// releases with e.g. -DLOGGER_MIN_LEVEL=LOG_INFO. Calls that survive check
+// the runtime level inline, before any argument is evaluated; the level is
+// read with a relaxed atomic load, so logger_set_level needs no lock.
+#ifndef LOGGER_MIN_LEVEL
+    #define LOGGER_MIN_LEVEL LOG_TRACE
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+    #define LOGGER_LEVEL_LOAD(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+    #define LOGGER_LEVEL_STORE(p, level) __atomic_store_n((p), (level), __ATOMIC_RELAXED)
+    #define LOGGER_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#else
+    // Aligned int loads and stores are atomic on the platforms MSVC targets
+    #define LOGGER_LEVEL_LOAD(p) (*(volatile const LogLevel*)(p))
+    #define LOGGER_LEVEL_STORE(p, level) (*(volatile LogLevel*)(p) = (level))
+    #define LOGGER_UNLIKELY(x) (x)
+#endif
+
+#define LOGGER_ENABLED(logger, level) \
+    ((level) >= LOGGER_MIN_LEVEL && (logger) && \
+     (level) >= LOGGER_LEVEL_LOAD(&(logger)->config.min_level))
+
+// Binary mode
+//
+// With LogConfig.binary set, the LOG_* macros record the format pointer, a
+// type signature worked out at compile time and the raw argument values,
+// and the writer thread does the formatting. This needs C11 (_Generic) and
+// a string literal format (anything else falls back to logger_log). Calls
+// with more than LOGGER_MAX_ARGS arguments including the format also fall
+// back; the count only goes up to 64, so longer ones do not compile.
+#define LOGGER_MAX_ARGS 16
+
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+// Type code of one argument after default argument promotion. Pointers are
+// 's' or 'p' here; the conversion in the format decides which is copied.
+#define LOGGER_ARG_TYPE(x) _Generic(((void)0, (x)), \
+    _Bool: 'i', char: 'i', signed char: 'i', unsigned char: 'i', \
+    short: 'i', unsigned short: 'i', int: 'i', unsigned int: 'I', \
+    long: 'l', unsigned long: 'L', long long: 'q', unsigned long long: 'Q', \
+    float: 'd', double: 'd', long double: 'D', \
+    char*: 's', const char*: 's', \
+    default: 'p')
+
+#define LOGGER_CAT_(a, b) a##b
+#define LOGGER_CAT(a, b) LOGGER_CAT_(a, b)
+// Argument count, or X for more than LOGGER_MAX_ARGS
+#define LOGGER_NARGS(...) LOGGER_NARGS_(__VA_ARGS__, \
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, \
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, \
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, \
+    16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define LOGGER_NARGS_(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, \
+    _15, _16, _17, _18, _19, _20, _21, _22, _23, _24, _25, _26, _27, _28, _29, _30, \
+    _31, _32, _33, _34, _35, _36, _37, _38, _39, _40, _41, _42, _43, _44, _45, _46, \
+    _47, _48, _49, _50, _51, _52, _53, _54, _55, _56, _57, _58, _59, _60, _61, _62, \
+    _63, _64, n, ...) n
+#define LOGGER_FIRST(...) LOGGER_FIRST_(__VA_ARGS__, 0)
+#define LOGGER_FIRST_(first, ...) first
+
+#define LOGGER_TYPES(...) LOGGER_CAT(LOGGER_TYPES_, LOGGER_NARGS(__VA_ARGS__))(__VA_ARGS__)
+#define LOGGER_TYPES_1(a) LOGGER_ARG_TYPE(a),
+#define LOGGER_TYPES_2(a, ...) LOGGER_ARG_TYPE(a), LOGGER_TYPES_1(__VA_ARGS__)
+#define LOGGER_TYPES_3(a, ...) LOGGER_ARG_TYPE(a), LOGGER_TYPES_2(__VA_ARGS__)
+#define LOGGER_TYPES_4(a, ...) LOGGER_ARG_TYPE(a), LOGGER_TYPES_3(__VA_ARGS__)
+#define LOGGER_TYPES_5(a, ...) LOGGER_ARG_TYPE(a), LOGGER_TYPES_4(__VA_ARGS__)
+#define LOGGER_TYPES_6(a, ...) LOGGER_ARG_TYPE(a), LOGGER_TYPES_5(__VA_ARGS__)
+#define LOGGER_TYPES_7(a, ...) LOGGER_ARG_TYPE(a), LOGGER_TYPES_6(__VA_ARGS__)
+#define LOGGER_TYPES_8(a, ...) LOGGER_ARG_TYPE(a), LOGGER_TYPES_7(__VA_ARGS__)
+#define LOGGER_TYPES_9(a, ...) LOGGER_ARG_TYPE(a), LOGGER_TYPES_8(__VA_ARGS__)
+#define LOGGER_TYPES_10(a, ...) LOGGER_ARG_TYPE(a), LOGGER_TYPES_9(__VA_ARGS__)
+#define LOGGER_TYPES_11(a, ...) LOGGER_ARG_TYPE(a), LOGGER_TYPES_10(__VA_ARGS__)
+#define LOGGER_TYPES_12(a, ...) LOGGER_ARG_TYPE(a), LOGGER_TYPES_11(__VA_ARGS__)
+#define LOGGER_TYPES_13(a, ...) LOGGER_ARG_TYPE(a), LOGGER_TYPES_12(__VA_ARGS__)
+#define LOGGER_TYPES_14(a, ...) LOGGER_ARG_TYPE(a), LOGGER_TYPES_13(__VA_ARGS__)
+#define LOGGER_TYPES_15(a, ...) LOGGER_ARG_TYPE(a), LOGGER_TYPES_14(__VA_ARGS__)
+#define LOGGER_TYPES_16(a, ...) LOGGER_ARG_TYPE(a), LOGGER_TYPES_15(__VA_ARGS__)
+#define LOGGER_TYPES_X(...)     // Too many: an empty signature selects logger_log
+
+// Only a string literal outlives the call, so only those are deferred
+#if defined(__GNUC__) || defined(__clang__)
+    #define LOGGER_IS_LITERAL(format) __builtin_constant_p(format)
+#else
+    #define LOGGER_IS_LITERAL(format) 0
+#endif
+
+#define LOGGER_LOG(level, ...) \
+    do { \
+        if (LOGGER_UNLIKELY(LOGGER_ENABLED(g_logger, level))) { \
+            static const char _log_signature[] = { LOGGER_TYPES(__VA_ARGS__) '\0' }; \
+            if (g_logger->config.binary && sizeof(_log_signature) > 1 && \
+                LOGGER_IS_LITERAL(LOGGER_FIRST(__VA_ARGS__))) { \
+                static const LogSite _log_site = { __FILE__, __LINE__, level, _log_signature }; \
+                logger_log_binary(g_logger, &_log_site, __VA_ARGS__); \
+            } else { \
+                logger_log(g_logger, level, __FILE__, __LINE__, __VA_ARGS__); \
+            } \
+        } \
+    } while (0)
+#else
+#define LOGGER_LOG(level, ...) \
+    do { \
+        if (LOGGER_UNLIKELY(LOGGER_ENABLED(g_logger, level))) \
+            logger_log(g_logger, level, __FILE__, __LINE__, __VA_ARGS__); \
+    } while (0)
+#endif
 
 // Convenience macros
-#define LOG_TRACE(...) \
-    if (g_logger) logger_log(g_logger, LOG_TRACE, __FILE__, __LINE__, __VA_ARGS__)
-#define LOG_DEBUG(...) \
-    if (g_logger) logger_log(g_logger, LOG_DEBUG, __FILE__, __LINE__, __VA_ARGS__)
-#define LOG_INFO(...) \
-    if (g_logger) logger_log(g_logger, LOG_INFO, __FILE__, __LINE__, __VA_ARGS__)
-#define LOG_WARN(...) \
-    if (g_logger) logger_log(g_logger, LOG_WARN, __FILE__, __LINE__, __VA_ARGS__)
-#define LOG_ERROR(...) \
-    if (g_logger) logger_log(g_logger, LOG_ERROR, __FILE__, __LINE__, __VA_ARGS__)
-#define LOG_FATAL(...) \
-    if (g_logger) logger_log(g_logger, LOG_FATAL, __FILE__, __LINE__, __VA_ARGS__)
+#define LOG_TRACE(...) LOGGER_LOG(LOG_TRACE, __VA_ARGS__)
+#define LOG_DEBUG(...) LOGGER_LOG(LOG_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...) LOGGER_LOG(LOG_INFO, __VA_ARGS__)
+#define LOG_WARN(...) LOGGER_LOG(LOG_WARN, __VA_ARGS__)
+#define LOG_ERROR(...) LOGGER_LOG(LOG_ERROR, __VA_ARGS__)
+#define LOG_FATAL(...) LOGGER_LOG(LOG_FATAL, __VA_ARGS__)
+
+// Rate-limited and sampled logging
+//
+// Each LOG_RATE_LIMITED / LOG_SAMPLED call site keeps its own LogLimit, so
+// one noisy site cannot starve another. The checks are lock-free and run
+// only if the level is enabled. A line that gets through ends with
+// "(N suppressed)" when calls were dropped since the previous one.
+//   LOG_RATE_LIMITED(LOG_ERROR, 10, 20, "...") - 10 lines/s, bursts of 20
+//   LOG_SAMPLED(LOG_WARN, 100, "...")          - the 1st, 101st, 201st, ...
+typedef struct {
+    int64_t next_ns;        // Token bucket as GCRA: when the next call is due
+    uint64_t calls;         // Sampling
+    uint64_t suppressed;    // Dropped since the last line that got through
+} LogLimit;
+
+bool logger_limit_rate(LogLimit *limit, double per_second, int burst, uint64_t *suppressed);
+bool logger_limit_sample(LogLimit *limit, unsigned every, uint64_t *suppressed);
+void logger_log_suppressed(Logger *logger, LogLevel level, const char *file, int line,
+                           uint64_t suppressed, const char *format, ...);
+
+#define LOG_RATE_LIMITED(level, per_second, burst, ...) \
+    do { \
+        static LogLimit _log_limit; \
+        uint64_t _log_suppressed; \
+        if (LOGGER_ENABLED(g_logger, level) && \
+            logger_limit_rate(&_log_limit, per_second, burst, &_log_suppressed)) { \
+            logger_log_suppressed(g_logger, level, __FILE__, __LINE__, _log_suppressed, \
+                                  __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define LOG_SAMPLED(level, every, ...) \
+    do { \
+        static LogLimit _log_limit; \
+        uint64_t _log_suppressed; \
+        if (LOGGER_ENABLED(g_logger, level) && \
+            logger_limit_sample(&_log_limit, every, &_log_suppressed)) { \
+            logger_log_suppressed(g_logger, level, __FILE__, __LINE__, _log_suppressed, \
+                                  __VA_ARGS__); \
+        } \
+    } while (0)
 
 // Assert with logging
 #define LOG_ASSERT(condition, ...) \
@@ -114,13 +292,38 @@ void logger_rotate_file(Logger *logger);
     } while(0)
 
 // Performance logging
+//
+// LOG_TIMER_END adds the time since LOG_TIMER_START to a histogram owned by
+// the calling thread, so timing a hot path costs two clock reads and a few
+// relaxed stores. logger_timer_report (called every timer_report_ms of
+// g_logger, or by hand) merges all threads and logs p50/p99/p999 for each
+// timer over the interval since the last report. With timer_report_ms 0
+// each measurement is also logged at LOG_DEBUG as it is taken.
+typedef struct {
+    const char *name;
+    const char *file;
+    int line;
+} LogTimer;
+
+// Timer ticks: the TSC on x86 with GCC/Clang (assumed invariant), else a
+// raw monotonic clock in nanoseconds
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    #define LOGGER_TIMER_TSC
+    static inline uint64_t logger_ticks(void) { return __builtin_ia32_rdtsc(); }
+#else
+    uint64_t logger_ticks(void);
+#endif
+
+void logger_timer_record(const LogTimer *timer, uint64_t ticks);
+void logger_timer_report(Logger *logger);
+
 #define LOG_TIMER_START(name) \
-    clock_t _timer_##name = clock()
+    uint64_t _timer_##name = logger_ticks()
 
 #define LOG_TIMER_END(name) \
     do { \
-        double _elapsed = ((double)(clock() - _timer_##name)) / CLOCKS_PER_SEC; \
-        LOG_DEBUG("Timer [" #name "] elapsed: %.3f seconds", _elapsed); \
+        static const LogTimer _timer_site_##name = { #name, __FILE__, __LINE__ }; \
+        logger_timer_record(&_timer_site_##name, logger_ticks() - _timer_##name); \
     } while(0)
 
 #endif // LOGGER_H
\ No newline at end of file
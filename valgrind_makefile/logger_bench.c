@@ -0,0 +1,287 @@
+// Logger benchmark
+//
+// Runs 1-64 threads logging through LOG_INFO for a fixed time against each
+// sink and mode, and reports lines/s, per-call latency percentiles and the
+// time spent waiting for the logger mutex (in async and binary mode that is
+// mostly the writer thread, since callers do not take it).
+//
+// Build: make bench, or gcc -O2 -std=c11 -pthread logger_bench.c logger.c
+// Usage: ./logger_bench [-t threads,...] [-r lines/s per thread, 0 = flat out]
+//                       [-d seconds] [-s null,file,mmap,console]
+//                       [-m sync,async,binary]
+//
+// Results go to stderr, so console runs can send the log itself elsewhere:
+//   ./logger_bench -s console > /dev/null
+// File sinks write to $TMPDIR (default /tmp) and are removed afterwards.
+
+#define _POSIX_C_SOURCE 200809L     // getopt, nanosleep, CLOCK_MONOTONIC_RAW
+
+#include "logger.h"
+
+#include <stdatomic.h>
+
+#define BENCH_MAX_THREADS 64
+#define BENCH_SUB 16                        // Histogram buckets per power of two
+#define BENCH_BUCKETS (61 * BENCH_SUB)
+
+typedef enum { SINK_NULL, SINK_FILE, SINK_MMAP, SINK_CONSOLE, SINK_COUNT } BenchSink;
+typedef enum { MODE_SYNC, MODE_ASYNC, MODE_BINARY, MODE_COUNT } BenchMode;
+
+static const char *sink_names[SINK_COUNT] = { "null", "file", "mmap", "console" };
+static const char *mode_names[MODE_COUNT] = { "sync", "async", "binary" };
+
+typedef struct {
+    pthread_t thread;
+    int id;
+    double rate;                    // Lines/s, 0 for as fast as possible
+    uint64_t calls;
+    uint64_t histogram[BENCH_BUCKETS];  // Call latency in ticks
+} BenchThread;
+
+static atomic_bool bench_start;
+static atomic_bool bench_stop;
+
+static int64_t bench_now_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Log-linear histogram, as in logger.c: exact below 32, then 16 buckets per
+// power of two
+static size_t bench_bucket(uint64_t value) {
+    if (value < 2 * BENCH_SUB) return (size_t)value;
+    int shift = 63 - __builtin_clzll(value) - 4;
+    return (size_t)shift * BENCH_SUB + (size_t)(value >> shift);
+}
+
+static double bench_bucket_middle(size_t bucket) {
+    if (bucket < 2 * BENCH_SUB) return (double)bucket;
+    size_t shift = bucket / BENCH_SUB - 1;
+    double start = (double)((uint64_t)(bucket % BENCH_SUB + BENCH_SUB) << shift);
+    return start + (double)(((uint64_t)1 << shift) - 1) / 2;
+}
+
+static double bench_quantile(const uint64_t *histogram, uint64_t total, double q) {
+    uint64_t rank = (uint64_t)(q * (double)total + 0.999999);
+    uint64_t seen = 0;
+    size_t bucket = 0;
+    
+    if (rank == 0) rank = 1;
+    for (; bucket < BENCH_BUCKETS - 1; bucket++) {
+        seen += histogram[bucket];
+        if (seen >= rank) break;
+    }
+    return bench_bucket_middle(bucket);
+}
+
+// Sleep until deadline on CLOCK_MONOTONIC, spinning for the last stretch
+static void bench_wait_until(int64_t deadline) {
+    int64_t now;
+    while ((now = bench_now_ns(CLOCK_MONOTONIC)) < deadline) {
+        if (deadline - now > 200000) {
+            struct timespec pause = { 0, deadline - now - 100000 };
+            nanosleep(&pause, NULL);
+        }
+    }
+}
+
+static void* bench_thread(void *arg) {
+    BenchThread *thread = (BenchThread*)arg;
+    
+    while (!atomic_load(&bench_start)) {}
+    int64_t start = bench_now_ns(CLOCK_MONOTONIC);
+    double interval = thread->rate > 0 ? 1e9 / thread->rate : 0;
+    
+    while (!atomic_load_explicit(&bench_stop, memory_order_relaxed)) {
+        if (interval > 0) bench_wait_until(start + (int64_t)(thread->calls * interval));
+        
+        uint64_t before = logger_ticks();
+        LOG_INFO("bench thread %d seq %llu value %.3f", thread->id,
+                 (unsigned long long)thread->calls, thread->calls * 0.5);
+        uint64_t elapsed = logger_ticks() - before;
+        
+        thread->histogram[bench_bucket(elapsed)]++;
+        thread->calls++;
+    }
+    return NULL;
+}
+
+// Remove a file sink's log and its backups
+static void remove_logs(const char *path, int backups) {
+    char name[600];
+    
+    remove(path);
+    for (int i = 1; i < backups; i++) {
+        snprintf(name, sizeof(name), "%s.%d", path, i);
+        remove(name);
+    }
+    snprintf(name, sizeof(name), "%s.next", path);
+    remove(name);
+}
+
+// One configuration; prints a result row
+static bool bench_run(BenchMode mode, BenchSink sink, int thread_count, double rate,
+                      double seconds, const char *log_path) {
+    LogConfig config = {
+        .min_level = LOG_INFO,
+        .use_colors = true,
+        .log_to_file = sink == SINK_FILE || sink == SINK_MMAP,
+        .log_to_console = sink == SINK_CONSOLE,
+        .include_timestamp = true,
+        .include_file_info = true,
+        .max_file_size = 10 * 1024 * 1024,
+        .max_backup_files = 5,
+        .async = mode == MODE_ASYNC,
+        .binary = mode == MODE_BINARY,
+        .mmap_file = sink == SINK_MMAP,
+        .background_rotation = sink == SINK_MMAP
+    };
+    snprintf(config.log_file_path, sizeof(config.log_file_path), "%s", log_path);
+    
+    remove_logs(log_path, config.max_backup_files);
+    g_logger = logger_create(&config);
+    if (!g_logger) return false;
+    
+    static BenchThread threads[BENCH_MAX_THREADS];
+    memset(threads, 0, sizeof(threads));
+    atomic_store(&bench_start, false);
+    atomic_store(&bench_stop, false);
+    
+    int started = 0;
+    for (; started < thread_count; started++) {
+        threads[started].id = started;
+        threads[started].rate = rate;
+        if (pthread_create(&threads[started].thread, NULL, bench_thread,
+                           &threads[started]) != 0) {
+            fprintf(stderr, "Failed to start thread %d\n", started);
+            break;
+        }
+    }
+    
+    int64_t start_ns = bench_now_ns(CLOCK_MONOTONIC_RAW);
+    uint64_t start_ticks = logger_ticks();
+    atomic_store(&bench_start, true);
+    
+    struct timespec duration = { (time_t)seconds,
+                                 (long)((seconds - (double)(time_t)seconds) * 1e9) };
+    nanosleep(&duration, NULL);
+    atomic_store(&bench_stop, true);
+    for (int i = 0; i < started; i++) pthread_join(threads[i].thread, NULL);
+    
+    // Queued lines count as done once written
+    logger_flush(g_logger);
+    int64_t elapsed_ns = bench_now_ns(CLOCK_MONOTONIC_RAW) - start_ns;
+    double ns_per_tick = (double)elapsed_ns / (double)(logger_ticks() - start_ticks);
+    uint64_t waits = g_logger->mutex_waits;
+    uint64_t wait_ns = g_logger->mutex_wait_ns;
+    logger_destroy(g_logger);
+    g_logger = NULL;
+    remove_logs(log_path, config.max_backup_files);
+    
+    static uint64_t histogram[BENCH_BUCKETS];
+    uint64_t total = 0;
+    size_t last = 0;
+    memset(histogram, 0, sizeof(histogram));
+    for (int i = 0; i < started; i++) {
+        for (size_t b = 0; b < BENCH_BUCKETS; b++) histogram[b] += threads[i].histogram[b];
+        total += threads[i].calls;
+    }
+    for (size_t b = 0; b < BENCH_BUCKETS; b++) {
+        if (histogram[b]) last = b;
+    }
+    if (total == 0) return false;
+    
+    fprintf(stderr, "%-7s %-8s %7d %10.0f %12.0f %9.0f %9.0f %9.0f %9.0f %10.0f %10llu %8.1f\n",
+            mode_names[mode], sink_names[sink], started, rate,
+            (double)total / ((double)elapsed_ns / 1e9),
+            bench_quantile(histogram, total, 0.50) * ns_per_tick,
+            bench_quantile(histogram, total, 0.90) * ns_per_tick,
+            bench_quantile(histogram, total, 0.99) * ns_per_tick,
+            bench_quantile(histogram, total, 0.999) * ns_per_tick,
+            bench_bucket_middle(last) * ns_per_tick,
+            (unsigned long long)waits, (double)wait_ns / 1e6);
+    return true;
+}
+
+// Parse a comma-separated list of names into flags
+static bool parse_names(char *list, const char **names, int count, bool *selected) {
+    for (int i = 0; i < count; i++) selected[i] = false;
+    
+    for (char *name = strtok(list, ","); name; name = strtok(NULL, ",")) {
+        int i = 0;
+        while (i < count && strcmp(name, names[i]) != 0) i++;
+        if (i == count) {
+            fprintf(stderr, "Unknown name: %s\n", name);
+            return false;
+        }
+        selected[i] = true;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    char default_threads[] = "1,2,4,8,16,32,64";
+    char default_sinks[] = "null,file,mmap,console";
+    char default_modes[] = "sync,async,binary";
+    char *thread_list = default_threads, *sink_list = default_sinks;
+    char *mode_list = default_modes;
+    double rate = 0, seconds = 1;
+    int option;
+    
+    while ((option = getopt(argc, argv, "t:r:d:s:m:")) != -1) {
+        switch (option) {
+            case 't': thread_list = optarg; break;
+            case 'r': rate = atof(optarg); break;
+            case 'd': seconds = atof(optarg); break;
+            case 's': sink_list = optarg; break;
+            case 'm': mode_list = optarg; break;
+            default:
+                fprintf(stderr, "Usage: %s [-t threads,...] [-r lines/s per thread] "
+                        "[-d seconds] [-s null,file,mmap,console] [-m sync,async,binary]\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+    
+    bool sinks[SINK_COUNT], modes[MODE_COUNT];
+    if (!parse_names(sink_list, sink_names, SINK_COUNT, sinks) ||
+        !parse_names(mode_list, mode_names, MODE_COUNT, modes)) {
+        return 1;
+    }
+    
+    int thread_counts[BENCH_MAX_THREADS], thread_runs = 0;
+    for (char *count = strtok(thread_list, ","); count; count = strtok(NULL, ",")) {
+        int n = atoi(count);
+        if (n < 1 || n > BENCH_MAX_THREADS || thread_runs == BENCH_MAX_THREADS) {
+            fprintf(stderr, "Thread counts must be 1-%d\n", BENCH_MAX_THREADS);
+            return 1;
+        }
+        thread_counts[thread_runs++] = n;
+    }
+    
+    const char *tmpdir = getenv("TMPDIR");
+    if (!tmpdir) tmpdir = "/tmp";
+    char log_path[256];
+    snprintf(log_path, sizeof(log_path), "%s/logger_bench.log", tmpdir);
+    
+    fprintf(stderr, "%-7s %-8s %7s %10s %12s %9s %9s %9s %9s %10s %10s %8s\n",
+            "mode", "sink", "threads", "rate", "lines/s", "p50 ns", "p90 ns", "p99 ns",
+            "p999 ns", "max ns", "waits", "wait ms");
+    
+    for (int mode = 0; mode < MODE_COUNT; mode++) {
+        if (!modes[mode]) continue;
+        for (int sink = 0; sink < SINK_COUNT; sink++) {
+            if (!sinks[sink]) continue;
+            for (int i = 0; i < thread_runs; i++) {
+                if (!bench_run((BenchMode)mode, (BenchSink)sink, thread_counts[i], rate,
+                               seconds, log_path)) {
+                    fprintf(stderr, "%-7s %-8s %7d failed\n", mode_names[mode],
+                            sink_names[sink], thread_counts[i]);
+                }
+            }
+        }
+    }
+    
+    return 0;
+}
@@ -0,0 +1,117 @@
+// Logger regression tests
+//
+// Logs a fixed set of calls in text and in binary mode and checks each line
+// of the log file against the message printf would have produced. Built with
+// AddressSanitizer, so an argument read past its end fails the run too.
+//
+// Build: make logtest, or
+//        gcc -g -std=c11 -fsanitize=address,undefined -pthread logger_test.c logger.c
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "logger.h"
+
+#include <wchar.h>
+
+#define TEST_MAX_CASES 32
+#define TEST_LINE_MAX 512
+
+static char expected[TEST_MAX_CASES][TEST_LINE_MAX];
+static int case_count;
+
+// Log one line and remember what it should read
+#define TEST_LOG(...) do { \
+    snprintf(expected[case_count++], TEST_LINE_MAX, __VA_ARGS__); \
+    LOG_INFO(__VA_ARGS__); \
+} while (0)
+
+static void log_cases(void) {
+    // Precision-limited views of buffers with no NUL after them
+    char *view = (char*)malloc(4);
+    memcpy(view, "abcd", 4);
+    int view_length = 4;
+    TEST_LOG("view=%.*s|", view_length, view);
+    TEST_LOG("view=%.4s|", view);
+    TEST_LOG("view=%.2s|%-6.3s|%8.*s|", view, view, 4, view);
+    TEST_LOG("view=%*.*s|", -7, 4, view);
+    TEST_LOG("whole=%.*s|", -1, "negative precision means none");
+    free(view);
+    
+    // Wide conversions are formatted by the caller
+    TEST_LOG("wide=%ls %lc|", L"text", (wint_t)L'w');
+    
+    // Calls with more than LOGGER_MAX_ARGS arguments, format included, go
+    // through logger_log
+    TEST_LOG("%d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %s",
+             1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, "seventeen");
+    TEST_LOG("%d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d",
+             1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16);
+    
+    TEST_LOG("%s %d %.1f %c", "mixed", -3, 2.5, 'z');
+}
+
+// Run the cases in one mode; returns the number of failures
+static int run_mode(bool binary) {
+    LogConfig config = {
+        .min_level = LOG_INFO,
+        .log_to_file = true,
+        .binary = binary,
+    };
+    const char *tmp = getenv("TMPDIR");
+    snprintf(config.log_file_path, sizeof(config.log_file_path), "%s/logger_test_%d.log",
+             tmp ? tmp : "/tmp", (int)getpid());
+    remove(config.log_file_path);
+    
+    g_logger = logger_create(&config);
+    if (!g_logger) {
+        fprintf(stderr, "logger_create failed\n");
+        return 1;
+    }
+    case_count = 0;
+    log_cases();
+    logger_destroy(g_logger);
+    g_logger = NULL;
+    
+    FILE *file = fopen(config.log_file_path, "r");
+    if (!file) {
+        fprintf(stderr, "Cannot open %s\n", config.log_file_path);
+        return 1;
+    }
+    
+    int failures = 0;
+    int line_count = 0;
+    char line[TEST_LINE_MAX];
+    while (fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\n")] = '\0';
+        const char *message = strstr(line, "] ");
+        message = message ? message + 2 : line;
+        
+        if (line_count >= case_count || strcmp(message, expected[line_count]) != 0) {
+            fprintf(stderr, "%s mode, line %d:\n  got      \"%s\"\n  expected \"%s\"\n",
+                    binary ? "binary" : "text", line_count + 1, message,
+                    line_count < case_count ? expected[line_count] : "(nothing)");
+            failures++;
+        }
+        line_count++;
+    }
+    if (line_count < case_count) {
+        fprintf(stderr, "%s mode: %d lines, expected %d\n",
+                binary ? "binary" : "text", line_count, case_count);
+        failures++;
+    }
+    
+    fclose(file);
+    remove(config.log_file_path);
+    return failures;
+}
+
+int main(void) {
+    int failures = run_mode(false) + run_mode(true);
+    
+    if (failures) {
+        fprintf(stderr, "%d logger test(s) failed\n", failures);
+        return 1;
+    }
+    printf("All logger tests passed (%d cases, text and binary)\n", case_count);
+    return 0;
+}